@@ -0,0 +1,427 @@
+#include "anytime.h"
+#include "localsearch.h"
+
+#define TRUE 1
+#define FALSE 0
+#define UNDEFINED -1
+
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* kicks in a row that may fail before the local search gives its thread up */
+#define ANYTIME_IDLE_KICKS 2000
+/* the subgradient step is halved after this many iterations without a better bound, times size */
+#define ANYTIME_STALE_ROUNDS 2
+/* and the bound is left as it is once the step is below this */
+#define ANYTIME_MIN_STEP 1e-6
+
+struct StructAnytime {
+    const int * weights;
+    int size;
+    double seconds;
+    atomic_int stop;
+    /* weight of tour */
+    atomic_int upper;
+    atomic_int lower;
+    int * tour;
+    /* set once the threads are asked to end, wakes the timer early */
+    int finished;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t timer;
+    pthread_t bound;
+    pthread_t kicker;
+};
+
+/* buffers of the 1-tree, allocated once per search */
+typedef struct {
+    double * key;
+    int * parent;
+    char * inTree;
+} TreeScratch, *pTreeScratch;
+
+static void * anytimeTimer(void * arg);
+static void * anytimeBound(void * arg);
+static void * anytimeKicker(void * arg);
+static void raiseLower(pAnytime a, int lower);
+static double oneTree(pAnytime a, pTreeScratch t, const double * pi, int * degrees);
+static void doubleBridge(const int * order, int size, int * out, unsigned int * seed);
+
+pAnytime startAnytime(const int * weights, int size, const int * tour, int weight, int lower,
+        double seconds) {
+    pAnytime a = (pAnytime) malloc(sizeof (Anytime));
+
+    if (a == NULL) {
+        printf("Error while allocating memory to start search\n");
+        exit(-1);
+    }
+
+    a->tour = (int*) malloc(sizeof (int) * (size + 1));
+
+    if (a->tour == NULL) {
+        printf("Error while allocating memory to start search\n");
+        exit(-1);
+    }
+
+    memcpy(a->tour, tour, sizeof (int) * (size + 1));
+    a->weights = weights;
+    a->size = size;
+    a->seconds = seconds;
+    a->finished = FALSE;
+    atomic_init(&a->stop, lower >= weight);
+    atomic_init(&a->upper, weight);
+    atomic_init(&a->lower, lower < weight ? lower : weight);
+    pthread_mutex_init(&a->lock, NULL);
+    pthread_cond_init(&a->wake, NULL);
+
+    if (pthread_create(&a->timer, NULL, anytimeTimer, a) != 0
+            || pthread_create(&a->bound, NULL, anytimeBound, a) != 0
+            || pthread_create(&a->kicker, NULL, anytimeKicker, a) != 0) {
+        printf("Error while starting search threads\n");
+        exit(-1);
+    }
+
+    return a;
+}
+
+int anytimeStopped(pAnytime a) {
+    return atomic_load_explicit(&a->stop, memory_order_relaxed);
+}
+
+int getAnytimeUpper(pAnytime a) {
+    return atomic_load_explicit(&a->upper, memory_order_relaxed);
+}
+
+void offerAnytimeTour(pAnytime a, const int * tour, int weight) {
+    pthread_mutex_lock(&a->lock);
+
+    if (weight < atomic_load(&a->upper)) {
+        memcpy(a->tour, tour, sizeof (int) * (a->size + 1));
+        atomic_store(&a->upper, weight);
+
+        if (weight <= atomic_load(&a->lower)) {
+            atomic_store(&a->stop, TRUE);
+            pthread_cond_broadcast(&a->wake);
+        }
+    }
+
+    pthread_mutex_unlock(&a->lock);
+}
+
+void proveAnytime(pAnytime a) {
+    pthread_mutex_lock(&a->lock);
+    atomic_store(&a->lower, atomic_load(&a->upper));
+    atomic_store(&a->stop, TRUE);
+    pthread_cond_broadcast(&a->wake);
+    pthread_mutex_unlock(&a->lock);
+}
+
+void waitAnytime(pAnytime a) {
+    pthread_mutex_lock(&a->lock);
+
+    while (!atomic_load(&a->stop)) {
+        pthread_cond_wait(&a->wake, &a->lock);
+    }
+
+    pthread_mutex_unlock(&a->lock);
+}
+
+int stopAnytime(pAnytime a, int * tour, int * bound) {
+    int upper;
+
+    pthread_mutex_lock(&a->lock);
+    a->finished = TRUE;
+    atomic_store(&a->stop, TRUE);
+    pthread_cond_broadcast(&a->wake);
+    pthread_mutex_unlock(&a->lock);
+
+    pthread_join(a->timer, NULL);
+    pthread_join(a->bound, NULL);
+    pthread_join(a->kicker, NULL);
+
+    upper = atomic_load(&a->upper);
+    *bound = atomic_load(&a->lower);
+    *bound = *bound < upper ? *bound : upper;
+    memcpy(tour, a->tour, sizeof (int) * (a->size + 1));
+
+    pthread_mutex_destroy(&a->lock);
+    pthread_cond_destroy(&a->wake);
+    free(a->tour);
+    free(a);
+
+    return upper;
+}
+
+void * anytimeTimer(void * arg) {
+    pAnytime a = (pAnytime) arg;
+    struct timespec deadline;
+    int rc = 0;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += (time_t) a->seconds;
+    deadline.tv_nsec += (long) ((a->seconds - (time_t) a->seconds) * 1e9);
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&a->lock);
+
+    while (!a->finished && !atomic_load(&a->stop) && rc != ETIMEDOUT) {
+        rc = pthread_cond_timedwait(&a->wake, &a->lock, &deadline);
+    }
+
+    atomic_store(&a->stop, TRUE);
+    pthread_cond_broadcast(&a->wake);
+    pthread_mutex_unlock(&a->lock);
+
+    return NULL;
+}
+
+void raiseLower(pAnytime a, int lower) {
+    pthread_mutex_lock(&a->lock);
+
+    if (lower > atomic_load(&a->lower)) {
+        atomic_store(&a->lower, lower);
+
+        if (lower >= atomic_load(&a->upper)) {
+            atomic_store(&a->stop, TRUE);
+            pthread_cond_broadcast(&a->wake);
+        }
+    }
+
+    pthread_mutex_unlock(&a->lock);
+}
+
+/*
+ * Weight of the minimum 1-tree under the penalties pi: a spanning tree of
+ * the nodes but 0, joined to node 0 by its two cheapest edges. Every tour is
+ * a 1-tree, so the weight less twice the penalties is a lower bound.
+ */
+double oneTree(pAnytime a, pTreeScratch t, const double * pi, int * degrees) {
+    const int * w = a->weights;
+    int size = a->size;
+    double * key = t->key;
+    int * parent = t->parent;
+    char * inTree = t->inTree;
+    double total = 0;
+    double first = INFINITY;
+    double second = INFINITY;
+    int cheapest = UNDEFINED;
+    int next = UNDEFINED;
+    int i, j;
+
+    for (i = 0; i < size; i++) {
+        key[i] = INFINITY;
+        parent[i] = UNDEFINED;
+        inTree[i] = FALSE;
+        degrees[i] = 0;
+    }
+
+    key[1] = 0;
+
+    /* prim over the dense matrix */
+    for (i = 1; i < size; i++) {
+        int u = UNDEFINED;
+
+        for (j = 1; j < size; j++) {
+            if (!inTree[j] && (u == UNDEFINED || key[j] < key[u])) {
+                u = j;
+            }
+        }
+
+        inTree[u] = TRUE;
+        total += key[u];
+
+        if (parent[u] != UNDEFINED) {
+            degrees[u]++;
+            degrees[parent[u]]++;
+        }
+
+        for (j = 1; j < size; j++) {
+            double c = w[u * size + j] + pi[u] + pi[j];
+            if (!inTree[j] && c < key[j]) {
+                key[j] = c;
+                parent[j] = u;
+            }
+        }
+    }
+
+    for (j = 1; j < size; j++) {
+        double c = w[j] + pi[0] + pi[j];
+        if (c < first) {
+            second = first;
+            next = cheapest;
+            first = c;
+            cheapest = j;
+        } else if (c < second) {
+            second = c;
+            next = j;
+        }
+    }
+
+    degrees[0] = 2;
+    degrees[cheapest]++;
+    degrees[next]++;
+    total += first + second;
+
+    for (i = 0; i < size; i++) {
+        total -= 2 * pi[i];
+    }
+
+    return total;
+}
+
+/* subgradient ascent of the 1-tree bound, moving the penalties toward degree 2 */
+void * anytimeBound(void * arg) {
+    pAnytime a = (pAnytime) arg;
+    int size = a->size;
+    TreeScratch tree;
+    double * pi;
+    int * degrees;
+    double best = -INFINITY;
+    double step = 2.0;
+    int stale = 0;
+    int i;
+
+    if (size < 3) {
+        return NULL;
+    }
+
+    pi = (double*) calloc(size, sizeof (double));
+    degrees = (int*) malloc(sizeof (int) * size);
+    tree.key = (double*) malloc(sizeof (double) * size);
+    tree.parent = (int*) malloc(sizeof (int) * size);
+    tree.inTree = (char*) malloc(sizeof (char) * size);
+
+    if (pi == NULL || degrees == NULL || tree.key == NULL || tree.parent == NULL || tree.inTree == NULL) {
+        printf("Error while allocating memory to bound search\n");
+        exit(-1);
+    }
+
+    while (!anytimeStopped(a) && step > ANYTIME_MIN_STEP) {
+        double bound = oneTree(a, &tree, pi, degrees);
+        double gap;
+        long long norm = 0;
+
+        for (i = 0; i < size; i++) {
+            norm += (long long) (degrees[i] - 2) * (degrees[i] - 2);
+        }
+
+        if (bound > best + ANYTIME_MIN_STEP) {
+            best = bound;
+            stale = 0;
+            /* weights are integers, so is the optimum */
+            raiseLower(a, (int) ceil(best - ANYTIME_MIN_STEP));
+        } else if (++stale >= ANYTIME_STALE_ROUNDS * size) {
+            step /= 2;
+            stale = 0;
+        }
+
+        gap = getAnytimeUpper(a) - bound;
+
+        /* a 1-tree of degree 2 everywhere is a tour no other beats */
+        if (norm == 0 || gap <= 0) {
+            break;
+        }
+
+        for (i = 0; i < size; i++) {
+            pi[i] += step * gap / norm * (degrees[i] - 2);
+        }
+    }
+
+    free(pi);
+    free(degrees);
+    free(tree.key);
+    free(tree.parent);
+    free(tree.inTree);
+    return NULL;
+}
+
+/* out receives order with its inner nodes cut in four runs A B C D and joined as A C B D */
+void doubleBridge(const int * order, int size, int * out, unsigned int * seed) {
+    int cuts[3];
+    int i, j, k = 0;
+
+    do {
+        for (i = 0; i < 3; i++) {
+            cuts[i] = 2 + (int) (rand_r(seed) % (unsigned int) (size - 2));
+        }
+        for (i = 1; i < 3; i++) {
+            for (j = i; j > 0 && cuts[j - 1] > cuts[j]; j--) {
+                int t = cuts[j];
+                cuts[j] = cuts[j - 1];
+                cuts[j - 1] = t;
+            }
+        }
+    } while (cuts[0] == cuts[1] || cuts[1] == cuts[2]);
+
+    for (i = 0; i < cuts[0]; i++) {
+        out[k++] = order[i];
+    }
+    for (i = cuts[1]; i < cuts[2]; i++) {
+        out[k++] = order[i];
+    }
+    for (i = cuts[0]; i < cuts[1]; i++) {
+        out[k++] = order[i];
+    }
+    for (i = cuts[2]; i <= size; i++) {
+        out[k++] = order[i];
+    }
+}
+
+/* iterated 2-opt, adopting the tours the exact search finds as well */
+void * anytimeKicker(void * arg) {
+    pAnytime a = (pAnytime) arg;
+    int size = a->size;
+    int * order;
+    int * trial;
+    unsigned int seed = (unsigned int) size;
+    int weight = INT_MAX;
+    int idle = 0;
+
+    /* fewer than 3 inner nodes leave nothing to kick */
+    if (size < 5) {
+        return NULL;
+    }
+
+    order = (int*) malloc(sizeof (int) * (size + 1));
+    trial = (int*) malloc(sizeof (int) * (size + 1));
+
+    if (order == NULL || trial == NULL) {
+        printf("Error while allocating memory to improve tour\n");
+        exit(-1);
+    }
+
+    while (!anytimeStopped(a) && idle < ANYTIME_IDLE_KICKS) {
+        int w;
+
+        if (getAnytimeUpper(a) < weight) {
+            pthread_mutex_lock(&a->lock);
+            memcpy(order, a->tour, sizeof (int) * (size + 1));
+            weight = atomic_load(&a->upper);
+            pthread_mutex_unlock(&a->lock);
+        }
+
+        doubleBridge(order, size, trial, &seed);
+        w = twoOpt(a->weights, size, trial);
+
+        if (w < weight) {
+            offerAnytimeTour(a, trial, w);
+            idle = 0;
+        } else {
+            idle++;
+        }
+    }
+
+    free(order);
+    free(trial);
+    return NULL;
+}
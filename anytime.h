@@ -0,0 +1,40 @@
+#ifndef GUARD_C_MPI_ANYTIME
+#define GUARD_C_MPI_ANYTIME
+
+/* the exact search looks at the stop flag once every 2^ANYTIME_STRIDE_BITS indexes */
+#define ANYTIME_STRIDE_BITS 10
+#define ANYTIME_MASK ((1 << ANYTIME_STRIDE_BITS) - 1)
+
+/*
+ * A search bounded by a wall-clock budget. Next to the exact search of the
+ * caller, one thread keeps kicking the best tour with a double bridge and
+ * polishing it by 2-opt, and another tightens the Held-Karp lower bound by
+ * subgradient steps over 1-trees. They share the weight of the best tour and
+ * a stop flag, raised by a timer thread at the deadline or as soon as the
+ * bound meets the best tour. Past the sizes the exact search can enumerate
+ * the caller only waits for those threads.
+ *
+ * Weights is a symmetric size x size matrix, tours are arrays of size + 1
+ * nodes from node 0.
+ */
+typedef struct StructAnytime Anytime, *pAnytime;
+
+// start the threads from tour, of weight weight, for at most seconds, every tour weighing
+// at least lower
+pAnytime startAnytime(const int * weights, int size, const int * tour, int weight, int lower,
+        double seconds);
+// return true once the search must stop, cheap enough for the hot loops
+int anytimeStopped(pAnytime a);
+// return the weight of the best tour known
+int getAnytimeUpper(pAnytime a);
+// keep tour when it is better than the best one known
+void offerAnytimeTour(pAnytime a, const int * tour, int weight);
+// every tour was searched, so the best one known is optimal
+void proveAnytime(pAnytime a);
+// block until the deadline or until the bound meets the best tour, for callers with no search of their own
+void waitAnytime(pAnytime a);
+// join the threads and free a, return the weight of the best tour put in tour
+// and its proven lower bound in *bound
+int stopAnytime(pAnytime a, int * tour, int * bound);
+
+#endif
@@ -0,0 +1,824 @@
+#include "batch.h"
+#include "construct.h"
+#include "graph.h"
+#include "query.h"
+#include "unrank.h"
+
+#define TRUE 1
+#define FALSE 0
+
+#ifdef USE_MPI_MALLOC
+#include <mpi.h>
+#endif
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define BATCH_LINE_SIZE 256
+#define BATCH_TAG_REQUEST 1
+#define BATCH_TAG_JOB 2
+#define BATCH_TAG_RESULT 3
+#define BATCH_TAG_DONE 4
+
+/* where the answers of the instances read from one stream are written */
+typedef struct {
+    FILE * in;
+    FILE * out;
+    int pending;
+    int reading;
+    int closable;
+    pthread_mutex_t lock;
+} Connection, *pConnection;
+
+typedef struct StructJob {
+    struct StructJob * next;
+    pInstance instance;
+    int index;
+    int owned;
+    /* NULL when the answer goes back to rank 0 */
+    pConnection connection;
+} Job, *pJob;
+
+typedef struct StructResult {
+    struct StructResult * next;
+    int * buffer;
+    int length;
+} Result, *pResult;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pJob first;
+    pJob last;
+    int closed;
+    pResult results;
+    int solved;
+    /* seconds each instance may take, 0 to solve it exactly */
+    double budget;
+    /* results store shared by the workers, NULL for none */
+    pResultCache cache;
+} Scheduler, *pScheduler;
+
+static int readInstances(FILE * in, pInstance * instances);
+static int compareInstances(const void * a, const void * b);
+static int solveInstance(pSolver solver, pInstance instance, double budget, int * order, int * bound);
+static int improveInstance(pInstance instance, double budget, int * order, int * bound);
+static void writeResult(FILE * out, pInstance instance, int weight, int bound, int * order);
+static void initScheduler(pScheduler sc, double budget, pResultCache cache);
+static void pushJob(pScheduler sc, pJob job);
+static pJob popJob(pScheduler sc);
+static void closeJobs(pScheduler sc);
+static void deliverResult(pScheduler sc, pJob job, int weight, int bound, int * order);
+static void releaseConnection(pConnection c);
+static pConnection createConnection(FILE * in, FILE * out, int closable);
+static void readConnection(pScheduler sc, pConnection c);
+static void * batchWorker(void * arg);
+static pthread_t * startWorkers(pScheduler sc, int threads);
+static void joinWorkers(pthread_t * workers, int threads);
+static double elapsedSeconds(struct timespec * start);
+
+int readInstance(FILE * in, pInstance instance) {
+    char line[BATCH_LINE_SIZE];
+    int capacity = 0;
+    int found = FALSE;
+
+    instance->count = 0;
+    instance->edges = NULL;
+
+    while (!found && fgets(line, sizeof (line), in) != NULL) {
+        found = sscanf(line, "instance %63s %d", instance->id, &instance->size) == 2;
+    }
+
+    if (!found) {
+        return FALSE;
+    }
+
+    while (fgets(line, sizeof (line), in) != NULL && strncmp(line, "end", 3) != 0) {
+        int src, dst;
+        long long weight;
+
+        if (sscanf(line, "%d %d %lld", &src, &dst, &weight) != 3) {
+            continue;
+        }
+
+        /* kept as -1 so that solveInstance reports the instance as an error */
+        if (weight < 0 || weight > INT_MAX) {
+            weight = -1;
+        }
+
+        if (instance->count == capacity) {
+            capacity = capacity == 0 ? 16 : capacity * 2;
+            instance->edges = (int*) realloc(instance->edges, sizeof (int) * 3 * capacity);
+
+            if (instance->edges == NULL) {
+                printf("Error while allocating memory to read instance\n");
+                exit(-1);
+            }
+        }
+
+        instance->edges[3 * instance->count] = src;
+        instance->edges[3 * instance->count + 1] = dst;
+        instance->edges[3 * instance->count + 2] = (int) weight;
+        instance->count++;
+    }
+
+    return TRUE;
+}
+
+void destroyInstance(pInstance instance) {
+    free(instance->edges);
+    instance->edges = NULL;
+}
+
+int readInstances(FILE * in, pInstance * instances) {
+    int count = 0;
+    int capacity = 16;
+
+    *instances = (pInstance) malloc(sizeof (Instance) * capacity);
+
+    while (*instances != NULL && readInstance(in, &(*instances)[count])) {
+        if (++count == capacity) {
+            capacity *= 2;
+            *instances = (pInstance) realloc(*instances, sizeof (Instance) * capacity);
+        }
+    }
+
+    if (*instances == NULL) {
+        printf("Error while allocating memory to read instances\n");
+        exit(-1);
+    }
+
+    return count;
+}
+
+int compareInstances(const void * a, const void * b) {
+    /* biggest first, the cost grows with the factorial of the size */
+    return ((const Instance *) b)->size - ((const Instance *) a)->size;
+}
+
+int solveInstance(pSolver solver, pInstance instance, double budget, int * order, int * bound) {
+    int i;
+
+    *bound = 0;
+
+    if (instance->size < 1) {
+        return -1;
+    }
+
+    for (i = 0; i < instance->count; i++) {
+        int src = instance->edges[3 * i];
+        int dst = instance->edges[3 * i + 1];
+        if (src < 0 || dst < 0 || src >= instance->size || dst >= instance->size
+                || instance->edges[3 * i + 2] < 0) {
+            return -1;
+        }
+    }
+
+    /* past the exhaustive search only a budget leaves something to do */
+    if (instance->size > UNRANK_MAX_NODES) {
+        return budget > 0 ? improveInstance(instance, budget, order, bound) : -1;
+    }
+
+    resetSolver(solver, instance->size);
+
+    for (i = 0; i < instance->count; i++) {
+        addSolverEdge(solver, instance->edges[3 * i], instance->edges[3 * i + 1], instance->edges[3 * i + 2]);
+    }
+
+    solve(solver);
+    *bound = getSolverBound(solver);
+    return getSolverTour(solver, order);
+}
+
+/* a construction polished by the anytime threads over the closure of the instance */
+int improveInstance(pInstance instance, double budget, int * order, int * bound) {
+    pBaseGraph g = createBaseGraph(instance->size, 1);
+    long long weight, lower;
+    int i;
+
+    for (i = 0; i < instance->count; i++) {
+        addBaseEdge(g, instance->edges[3 * i], instance->edges[3 * i + 1], instance->edges[3 * i + 2]);
+    }
+
+    weight = improveTour(g, CONSTRUCT_GREEDY_EDGE, 1, budget, order, &lower);
+    destroyBaseGraph(g);
+
+    if (weight < 0 || weight > INT_MAX) {
+        return -1;
+    }
+
+    *bound = (int) lower;
+    return (int) weight;
+}
+
+void writeResult(FILE * out, pInstance instance, int weight, int bound, int * order) {
+    int i;
+
+    if (weight < 0) {
+        fprintf(out, "%s error\n", instance->id);
+    } else {
+        fprintf(out, "%s %d", instance->id, weight);
+        for (i = 0; i <= instance->size; i++) {
+            fprintf(out, " %d", order[i]);
+        }
+        if (bound < weight) {
+            fprintf(out, " bound %d", bound);
+        }
+        fprintf(out, "\n");
+    }
+
+    fflush(out);
+}
+
+void initScheduler(pScheduler sc, double budget, pResultCache cache) {
+    pthread_mutex_init(&sc->lock, NULL);
+    pthread_cond_init(&sc->changed, NULL);
+    sc->first = sc->last = NULL;
+    sc->closed = FALSE;
+    sc->results = NULL;
+    sc->solved = 0;
+    sc->budget = budget;
+    sc->cache = cache;
+}
+
+void pushJob(pScheduler sc, pJob job) {
+    pthread_mutex_lock(&sc->lock);
+    job->next = NULL;
+    if (sc->last == NULL) {
+        sc->first = job;
+    } else {
+        sc->last->next = job;
+    }
+    sc->last = job;
+    pthread_cond_broadcast(&sc->changed);
+    pthread_mutex_unlock(&sc->lock);
+}
+
+pJob popJob(pScheduler sc) {
+    pJob job;
+
+    pthread_mutex_lock(&sc->lock);
+
+    while (sc->first == NULL && !sc->closed) {
+        pthread_cond_wait(&sc->changed, &sc->lock);
+    }
+
+    job = sc->first;
+
+    if (job != NULL) {
+        sc->first = job->next;
+        if (sc->first == NULL) {
+            sc->last = NULL;
+        }
+    }
+
+    pthread_mutex_unlock(&sc->lock);
+    return job;
+}
+
+void closeJobs(pScheduler sc) {
+    pthread_mutex_lock(&sc->lock);
+    sc->closed = TRUE;
+    pthread_cond_broadcast(&sc->changed);
+    pthread_mutex_unlock(&sc->lock);
+}
+
+pConnection createConnection(FILE * in, FILE * out, int closable) {
+    pConnection c = (pConnection) malloc(sizeof (Connection));
+
+    if (c == NULL) {
+        printf("Error while allocating memory for connection\n");
+        exit(-1);
+    }
+
+    c->in = in;
+    c->out = out;
+    c->pending = 0;
+    c->reading = TRUE;
+    c->closable = closable;
+    pthread_mutex_init(&c->lock, NULL);
+    return c;
+}
+
+void releaseConnection(pConnection c) {
+    /* called with c->lock held once nothing more will be written */
+    pthread_mutex_unlock(&c->lock);
+
+    if (c->closable) {
+        fclose(c->in);
+        fclose(c->out);
+        pthread_mutex_destroy(&c->lock);
+        free(c);
+    }
+}
+
+void deliverResult(pScheduler sc, pJob job, int weight, int bound, int * order) {
+    pConnection c = job->connection;
+
+    if (c != NULL) {
+        pthread_mutex_lock(&c->lock);
+        writeResult(c->out, job->instance, weight, bound, order);
+        if (--c->pending == 0 && !c->reading) {
+            releaseConnection(c);
+        } else {
+            pthread_mutex_unlock(&c->lock);
+        }
+    } else {
+        pResult r = (pResult) malloc(sizeof (Result));
+        int size = job->instance->size;
+
+        if (r == NULL) {
+            printf("Error while allocating memory for result\n");
+            exit(-1);
+        }
+
+        r->length = weight < 0 ? 3 : size + 4;
+        r->buffer = (int*) malloc(sizeof (int) * r->length);
+
+        if (r->buffer == NULL) {
+            printf("Error while allocating memory for result\n");
+            exit(-1);
+        }
+
+        r->buffer[0] = job->index;
+        r->buffer[1] = weight;
+        r->buffer[2] = bound;
+        if (weight >= 0) {
+            memcpy(r->buffer + 3, order, sizeof (int) * (size + 1));
+        }
+
+        pthread_mutex_lock(&sc->lock);
+        r->next = sc->results;
+        sc->results = r;
+        pthread_cond_broadcast(&sc->changed);
+        pthread_mutex_unlock(&sc->lock);
+    }
+
+    pthread_mutex_lock(&sc->lock);
+    sc->solved++;
+    pthread_mutex_unlock(&sc->lock);
+}
+
+void * batchWorker(void * arg) {
+    pScheduler sc = (pScheduler) arg;
+    /* one solver per thread, its buffers are reused across instances */
+    pSolver solver = createLocalSolver(1);
+    int capacity = UNRANK_MAX_NODES + 1;
+    int * order = (int*) malloc(sizeof (int) * capacity);
+    pJob job;
+
+    if (order == NULL) {
+        printf("Error while allocating memory for worker\n");
+        exit(-1);
+    }
+
+    setSolverBudget(solver, sc->budget);
+    setSolverCache(solver, sc->cache);
+
+    while ((job = popJob(sc)) != NULL) {
+        int weight, bound;
+
+        if (job->instance->size + 1 > capacity) {
+            capacity = job->instance->size + 1;
+            free(order);
+            order = (int*) malloc(sizeof (int) * capacity);
+
+            if (order == NULL) {
+                printf("Error while allocating memory for worker\n");
+                exit(-1);
+            }
+        }
+
+        weight = solveInstance(solver, job->instance, sc->budget, order, &bound);
+        deliverResult(sc, job, weight, bound, order);
+
+        if (job->owned) {
+            destroyInstance(job->instance);
+            free(job->instance);
+        }
+        free(job);
+    }
+
+    destroySolver(solver);
+    free(order);
+    return NULL;
+}
+
+pthread_t * startWorkers(pScheduler sc, int threads) {
+    pthread_t * workers = (pthread_t*) malloc(sizeof (pthread_t) * threads);
+    int i;
+
+    if (workers == NULL) {
+        printf("Error while allocating memory for workers\n");
+        exit(-1);
+    }
+
+    for (i = 0; i < threads; i++) {
+        if (pthread_create(&workers[i], NULL, batchWorker, sc) != 0) {
+            printf("Error while starting worker\n");
+            exit(-1);
+        }
+    }
+
+    return workers;
+}
+
+void joinWorkers(pthread_t * workers, int threads) {
+    int i;
+    for (i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+}
+
+double elapsedSeconds(struct timespec * start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static pJob createJob(pInstance instance, int index, int owned, pConnection connection);
+
+pJob createJob(pInstance instance, int index, int owned, pConnection connection) {
+    pJob job = (pJob) malloc(sizeof (Job));
+
+    if (job == NULL) {
+        printf("Error while allocating memory for job\n");
+        exit(-1);
+    }
+
+    job->instance = instance;
+    job->index = index;
+    job->owned = owned;
+    job->connection = connection;
+    return job;
+}
+
+#ifdef USE_MPI_MALLOC
+static void batchMaster(pInstance instances, int count, FILE * out, int size);
+static void batchWorkerRank(int threads, double budget, pResultCache cache);
+
+/*
+ * Rank 0 only hands out instances, biggest first, to whichever rank asks for
+ * one and writes the answers it gets back. Every other rank keeps one request
+ * in flight per thread, so a rank stuck on a big instance never holds work
+ * another one could take.
+ */
+void batchMaster(pInstance instances, int count, FILE * out, int size) {
+    int next = 0;
+    int active = size - 1;
+
+    while (active > 0) {
+        MPI_Status status;
+        int length;
+        int * buffer;
+
+        MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+        MPI_Get_count(&status, MPI_INT, &length);
+
+        buffer = (int*) malloc(sizeof (int) * (length + 1));
+
+        if (buffer == NULL) {
+            printf("Error while allocating memory for batch message\n");
+            exit(-1);
+        }
+
+        MPI_Recv(buffer, length, MPI_INT, status.MPI_SOURCE, status.MPI_TAG,
+                MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+        if (status.MPI_TAG == BATCH_TAG_RESULT) {
+            writeResult(out, &instances[buffer[0]], buffer[1], buffer[2], buffer + 3);
+        } else if (status.MPI_TAG == BATCH_TAG_DONE) {
+            active--;
+        } else if (next < count) {
+            pInstance instance = &instances[next];
+            int * job = (int*) malloc(sizeof (int) * (3 + 3 * instance->count));
+
+            if (job == NULL) {
+                printf("Error while allocating memory for batch message\n");
+                exit(-1);
+            }
+
+            job[0] = next++;
+            job[1] = instance->size;
+            job[2] = instance->count;
+            memcpy(job + 3, instance->edges, sizeof (int) * 3 * instance->count);
+            MPI_Send(job, 3 + 3 * instance->count, MPI_INT, status.MPI_SOURCE,
+                    BATCH_TAG_JOB, MPI_COMM_WORLD);
+            free(job);
+        } else {
+            int none = -1;
+            MPI_Send(&none, 1, MPI_INT, status.MPI_SOURCE, BATCH_TAG_JOB, MPI_COMM_WORLD);
+        }
+
+        free(buffer);
+    }
+}
+
+void batchWorkerRank(int threads, double budget, pResultCache cache) {
+    Scheduler sc;
+    pthread_t * workers;
+    int outstanding = 0;
+    int exhausted = FALSE;
+
+    initScheduler(&sc, budget, cache);
+    workers = startWorkers(&sc, threads);
+
+    while (!exhausted || outstanding > 0) {
+        pResult results;
+
+        while (!exhausted && outstanding < threads) {
+            MPI_Status status;
+            int length;
+            int * buffer;
+
+            MPI_Send(&outstanding, 1, MPI_INT, 0, BATCH_TAG_REQUEST, MPI_COMM_WORLD);
+            MPI_Probe(0, BATCH_TAG_JOB, MPI_COMM_WORLD, &status);
+            MPI_Get_count(&status, MPI_INT, &length);
+
+            buffer = (int*) malloc(sizeof (int) * length);
+
+            if (buffer == NULL) {
+                printf("Error while allocating memory for batch message\n");
+                exit(-1);
+            }
+
+            MPI_Recv(buffer, length, MPI_INT, 0, BATCH_TAG_JOB, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+            if (buffer[0] < 0) {
+                exhausted = TRUE;
+                closeJobs(&sc);
+            } else {
+                pInstance instance = (pInstance) malloc(sizeof (Instance));
+
+                if (instance == NULL) {
+                    printf("Error while allocating memory for instance\n");
+                    exit(-1);
+                }
+
+                snprintf(instance->id, BATCH_ID_SIZE, "%d", buffer[0]);
+                instance->size = buffer[1];
+                instance->count = buffer[2];
+                instance->edges = (int*) malloc(sizeof (int) * (3 * instance->count + 1));
+
+                if (instance->edges == NULL) {
+                    printf("Error while allocating memory for instance\n");
+                    exit(-1);
+                }
+
+                memcpy(instance->edges, buffer + 3, sizeof (int) * 3 * instance->count);
+                pushJob(&sc, createJob(instance, buffer[0], TRUE, NULL));
+                outstanding++;
+            }
+
+            free(buffer);
+        }
+
+        pthread_mutex_lock(&sc.lock);
+        while (sc.results == NULL && outstanding > 0) {
+            pthread_cond_wait(&sc.changed, &sc.lock);
+        }
+        results = sc.results;
+        sc.results = NULL;
+        pthread_mutex_unlock(&sc.lock);
+
+        while (results != NULL) {
+            pResult r = results;
+            results = r->next;
+            MPI_Send(r->buffer, r->length, MPI_INT, 0, BATCH_TAG_RESULT, MPI_COMM_WORLD);
+            outstanding--;
+            free(r->buffer);
+            free(r);
+        }
+    }
+
+    MPI_Send(&outstanding, 1, MPI_INT, 0, BATCH_TAG_DONE, MPI_COMM_WORLD);
+    joinWorkers(workers, threads);
+}
+#endif
+
+void runBatch(int argc, char* argv[], const char * input, const char * output, int threads,
+        double budget, pResultCache cache) {
+    pInstance instances = NULL;
+    int count = 0;
+    int i;
+    int rank = 0;
+    int size = 1;
+    FILE * out = stdout;
+    struct timespec start;
+
+#ifdef USE_MPI_MALLOC
+    int provided;
+    /* only the main thread calls MPI, the workers build local solvers */
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+#else
+    (void) argc;
+    (void) argv;
+#endif
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (rank == 0) {
+        FILE * in = strcmp(input, "-") == 0 ? stdin : fopen(input, "r");
+
+        if (in == NULL) {
+            printf("Error while opening %s\n", input);
+            exit(-1);
+        }
+
+        count = readInstances(in, &instances);
+
+        if (in != stdin) {
+            fclose(in);
+        }
+
+        if (output != NULL) {
+            out = fopen(output, "w");
+            if (out == NULL) {
+                printf("Error while opening %s\n", output);
+                exit(-1);
+            }
+        }
+
+        qsort(instances, count, sizeof (Instance), compareInstances);
+    }
+
+#ifdef USE_MPI_MALLOC
+    if (size > 1) {
+        if (rank == 0) {
+            batchMaster(instances, count, out, size);
+        } else {
+            batchWorkerRank(threads, budget, cache);
+        }
+    }
+#endif
+
+    if (size == 1) {
+        Scheduler sc;
+        pConnection c = createConnection(NULL, out, FALSE);
+        pthread_t * workers;
+
+        initScheduler(&sc, budget, cache);
+        workers = startWorkers(&sc, threads);
+
+        c->pending = count;
+
+        for (i = 0; i < count; i++) {
+            pushJob(&sc, createJob(&instances[i], i, FALSE, c));
+        }
+
+        closeJobs(&sc);
+        joinWorkers(workers, threads);
+        free(c);
+    }
+
+    if (cache != NULL) {
+        long counts[2];
+        long total[2];
+
+        getResultCacheStats(cache, &counts[0], &counts[1]);
+        total[0] = counts[0];
+        total[1] = counts[1];
+#ifdef USE_MPI_MALLOC
+        /* the ranks solving hold the counts, rank 0 only hands out instances */
+        MPI_Reduce(counts, total, 2, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+#endif
+        if (rank == 0) {
+            fprintf(stderr, "Result cache: %ld hits, %ld misses\n", total[0], total[1]);
+        }
+    }
+
+    if (rank == 0) {
+        double seconds = elapsedSeconds(&start);
+
+        fprintf(stderr, "Solved %d instances in %.3f seconds (%.1f instances/s)\n",
+                count, seconds, seconds > 0 ? count / seconds : 0.0);
+
+        for (i = 0; i < count; i++) {
+            destroyInstance(&instances[i]);
+        }
+
+        free(instances);
+
+        if (out != stdout) {
+            fclose(out);
+        }
+    }
+
+#ifdef USE_MPI_MALLOC
+    MPI_Finalize();
+#endif
+}
+
+void readConnection(pScheduler sc, pConnection c) {
+    pInstance instance;
+    int index = 0;
+
+    for (;;) {
+        instance = (pInstance) malloc(sizeof (Instance));
+
+        if (instance == NULL) {
+            printf("Error while allocating memory for instance\n");
+            exit(-1);
+        }
+
+        if (!readInstance(c->in, instance)) {
+            free(instance);
+            break;
+        }
+
+        pthread_mutex_lock(&c->lock);
+        c->pending++;
+        pthread_mutex_unlock(&c->lock);
+
+        pushJob(sc, createJob(instance, index++, TRUE, c));
+    }
+
+    pthread_mutex_lock(&c->lock);
+    c->reading = FALSE;
+    if (c->pending == 0) {
+        releaseConnection(c);
+    } else {
+        pthread_mutex_unlock(&c->lock);
+    }
+}
+
+typedef struct {
+    pScheduler sc;
+    pConnection c;
+} Reader, *pReader;
+
+static void * connectionReader(void * arg);
+
+void * connectionReader(void * arg) {
+    pReader reader = (pReader) arg;
+    readConnection(reader->sc, reader->c);
+    free(reader);
+    return NULL;
+}
+
+void runServer(const char * path, int threads, double budget, pResultCache cache) {
+    Scheduler sc;
+    pthread_t * workers;
+
+    initScheduler(&sc, budget, cache);
+    workers = startWorkers(&sc, threads);
+
+    if (path == NULL) {
+        pConnection c = createConnection(stdin, stdout, FALSE);
+        readConnection(&sc, c);
+        closeJobs(&sc);
+        joinWorkers(workers, threads);
+        free(c);
+    } else {
+        struct sockaddr_un address;
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+        memset(&address, 0, sizeof (address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, path, sizeof (address.sun_path) - 1);
+        unlink(path);
+
+        if (listener < 0 || bind(listener, (struct sockaddr *) &address, sizeof (address)) != 0
+                || listen(listener, 16) != 0) {
+            printf("Error while listening on %s\n", path);
+            exit(-1);
+        }
+
+        for (;;) {
+            int fd = accept(listener, NULL, NULL);
+            pReader reader;
+            pthread_t thread;
+
+            if (fd < 0) {
+                continue;
+            }
+
+            reader = (pReader) malloc(sizeof (Reader));
+
+            if (reader == NULL) {
+                printf("Error while allocating memory for connection\n");
+                exit(-1);
+            }
+
+            reader->sc = &sc;
+            reader->c = createConnection(fdopen(fd, "r"), fdopen(dup(fd), "w"), TRUE);
+
+            if (pthread_create(&thread, NULL, connectionReader, reader) != 0) {
+                printf("Error while starting connection reader\n");
+                exit(-1);
+            }
+
+            pthread_detach(thread);
+        }
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef GUARD_C_MPI_BATCH
+#define GUARD_C_MPI_BATCH
+
+#include <stdio.h>
+
+#include "cache.h"
+
+#define BATCH_ID_SIZE 64
+
+typedef struct {
+    char id[BATCH_ID_SIZE];
+    int size;
+    int count;
+    /* count triples of src, dst, weight */
+    int * edges;
+} Instance, *pInstance;
+
+/*
+ * Instances are read as
+ *
+ *   instance <id> <size>
+ *   <src> <dst> <weight>
+ *   ...
+ *   end
+ *
+ * with nodes numbered from 0, and answered with one line per instance
+ *
+ *   <id> <weight> <node> ... <node>
+ *
+ * as soon as it is solved, or "<id> error" when it cannot be solved. Under a
+ * time budget a tour not proven optimal is followed by "bound <weight>", the
+ * lower bound proven for it. Only a budget lets instances past the sizes the
+ * exhaustive search enumerates through, toured by a construction polished by
+ * the anytime threads until the budget runs out.
+ */
+
+// return true or false
+int readInstance(FILE * in, pInstance instance);
+void destroyInstance(pInstance instance);
+
+// solve every instance of input ("-" for stdin), biggest first, writing to output (NULL for stdout),
+// giving each one at most budget seconds (0 for no limit) and looking each one up in cache
+// first (NULL for none)
+void runBatch(int argc, char* argv[], const char * input, const char * output, int threads,
+        double budget, pResultCache cache);
+// keep threads warm answering instances from a unix socket, or stdin/stdout when path is NULL
+void runServer(const char * path, int threads, double budget, pResultCache cache);
+
+#endif
@@ -0,0 +1,396 @@
+#include "cache.h"
+
+#define TRUE 1
+#define FALSE 0
+#define UNDEFINED -1
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CACHE_MAGIC 0x54535043
+#define CACHE_VERSION 3
+/* slots an instance may take from its home slot on */
+#define CACHE_PROBES 8
+/* reads of a slot retried while a writer is in it */
+#define CACHE_RETRIES 4
+#define CACHE_EDGES (CACHE_MAX_NODES * (CACHE_MAX_NODES - 1) / 2)
+/* size legs of at most size - 1 edges fit, a longer walk is not stored */
+#define CACHE_WALK (CACHE_MAX_NODES * CACHE_MAX_NODES + 1)
+
+typedef struct {
+    int magic;
+    int version;
+    int slots;
+    int slotBytes;
+} CacheHeader;
+
+/* a size of 0 marks a free slot, the probes of a lookup stop at the first one */
+typedef struct {
+    /* odd while a writer is in the slot */
+    unsigned int sequence;
+    int size;
+    unsigned long long hash;
+    int weight;
+    int walkLength;
+    /* upper triangle of the canonical edge matrix, row by row */
+    int edges[CACHE_EDGES];
+    /* tour and walk in canonical labels */
+    int tour[CACHE_MAX_NODES + 1];
+    int walk[CACHE_WALK];
+} CacheSlot, *pCacheSlot;
+
+struct StructResultCache {
+    int fd;
+    size_t bytes;
+    void * base;
+    pCacheSlot slots;
+    int count;
+    /* flock only keeps other processes out */
+    pthread_mutex_t lock;
+    long hits;
+    long misses;
+};
+
+typedef struct {
+    unsigned long long signature;
+    int node;
+} Signature;
+
+static unsigned long long mixSignature(unsigned long long x);
+static int compareSignatures(const void * a, const void * b);
+static int countClasses(Signature * sorted, const unsigned long long * signatures, int size);
+static void canonicalLabels(const int * edges, int size, int * labels);
+static unsigned long long canonicalKey(const int * edges, int size, const int * labels, int * triangle);
+static int readSlot(pCacheSlot slot, pCacheSlot copy);
+
+pResultCache openResultCache(const char * path, int slots) {
+    pResultCache c = (pResultCache) malloc(sizeof (ResultCache));
+    CacheHeader header;
+    struct stat st;
+
+    if (c == NULL) {
+        printf("Error while allocating memory for result cache\n");
+        exit(-1);
+    }
+
+    c->fd = open(path, O_RDWR | O_CREAT, 0644);
+
+    if (c->fd < 0 || flock(c->fd, LOCK_EX) != 0 || fstat(c->fd, &st) != 0) {
+        printf("Error while opening %s\n", path);
+        exit(-1);
+    }
+
+    /* whoever takes the lock first on an empty file lays it out */
+    if (st.st_size == 0) {
+        header.magic = CACHE_MAGIC;
+        header.version = CACHE_VERSION;
+        header.slots = slots > 0 ? slots : CACHE_SLOTS;
+        header.slotBytes = (int) sizeof (CacheSlot);
+
+        if (ftruncate(c->fd, (off_t) (sizeof (CacheHeader) + sizeof (CacheSlot) * (size_t) header.slots)) != 0
+                || pwrite(c->fd, &header, sizeof (header), 0) != (ssize_t) sizeof (header)) {
+            printf("Error while creating %s\n", path);
+            exit(-1);
+        }
+    } else if (pread(c->fd, &header, sizeof (header), 0) != (ssize_t) sizeof (header)
+            || header.magic != CACHE_MAGIC || header.version != CACHE_VERSION
+            || header.slotBytes != (int) sizeof (CacheSlot) || header.slots < 1) {
+        printf("Error while reading %s, it is not a result cache\n", path);
+        exit(-1);
+    }
+
+    flock(c->fd, LOCK_UN);
+
+    c->count = header.slots;
+    c->bytes = sizeof (CacheHeader) + sizeof (CacheSlot) * (size_t) c->count;
+    c->base = mmap(NULL, c->bytes, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, 0);
+
+    if (c->base == MAP_FAILED) {
+        printf("Error while mapping %s\n", path);
+        exit(-1);
+    }
+
+    c->slots = (pCacheSlot) ((char *) c->base + sizeof (CacheHeader));
+    c->hits = 0;
+    c->misses = 0;
+    pthread_mutex_init(&c->lock, NULL);
+
+    return c;
+}
+
+void closeResultCache(pResultCache c) {
+    if (c != NULL) {
+        munmap(c->base, c->bytes);
+        close(c->fd);
+        pthread_mutex_destroy(&c->lock);
+        free(c);
+    }
+}
+
+void getResultCacheStats(pResultCache c, long * hits, long * misses) {
+    *hits = __atomic_load_n(&c->hits, __ATOMIC_RELAXED);
+    *misses = __atomic_load_n(&c->misses, __ATOMIC_RELAXED);
+}
+
+unsigned long long mixSignature(unsigned long long x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+int compareSignatures(const void * a, const void * b) {
+    const Signature * x = (const Signature *) a;
+    const Signature * y = (const Signature *) b;
+    if (x->signature != y->signature) {
+        return x->signature < y->signature ? -1 : 1;
+    }
+    return x->node - y->node;
+}
+
+/* return the distinct signatures, sorted receiving the nodes in canonical order */
+int countClasses(Signature * sorted, const unsigned long long * signatures, int size) {
+    int classes = 0;
+    int i;
+
+    for (i = 0; i < size; i++) {
+        sorted[i].signature = signatures[i];
+        sorted[i].node = i;
+    }
+
+    qsort(sorted, size, sizeof (Signature), compareSignatures);
+
+    for (i = 0; i < size; i++) {
+        if (i == 0 || sorted[i].signature != sorted[i - 1].signature) {
+            classes++;
+        }
+    }
+
+    return classes;
+}
+
+/*
+ * A node starts from the multiset of the weights of its edges, then takes in
+ * the signatures of its neighbors through those weights until no class
+ * splits anymore. Sums keep the signatures free of the labels, only nodes
+ * left tied are ordered by their label.
+ */
+void canonicalLabels(const int * edges, int size, int * labels) {
+    unsigned long long signatures[CACHE_MAX_NODES];
+    unsigned long long next[CACHE_MAX_NODES];
+    Signature sorted[CACHE_MAX_NODES];
+    int classes, round, u, v;
+
+    for (v = 0; v < size; v++) {
+        signatures[v] = mixSignature((unsigned long long) size);
+        for (u = 0; u < size; u++) {
+            if (u != v && edges[v * size + u] != 0) {
+                signatures[v] += mixSignature((unsigned long long) (unsigned int) edges[v * size + u]);
+            }
+        }
+    }
+
+    classes = countClasses(sorted, signatures, size);
+
+    for (round = 0; round < size && classes < size; round++) {
+        int refined;
+
+        for (v = 0; v < size; v++) {
+            next[v] = mixSignature(signatures[v]);
+            for (u = 0; u < size; u++) {
+                if (u != v && edges[v * size + u] != 0) {
+                    next[v] += mixSignature(signatures[u]
+                            ^ mixSignature((unsigned long long) (unsigned int) edges[v * size + u]));
+                }
+            }
+        }
+
+        memcpy(signatures, next, sizeof (unsigned long long) * size);
+        refined = countClasses(sorted, signatures, size);
+
+        if (refined == classes) {
+            break;
+        }
+
+        classes = refined;
+    }
+
+    for (v = 0; v < size; v++) {
+        labels[v] = sorted[v].node;
+    }
+}
+
+/* FNV-1a over the size and the upper triangle of the relabeled matrix, put in triangle */
+unsigned long long canonicalKey(const int * edges, int size, const int * labels, int * triangle) {
+    unsigned long long hash = 14695981039346656037ULL;
+    int i, j, k = 0;
+
+    hash = (hash ^ (unsigned long long) size) * 1099511628211ULL;
+
+    for (i = 0; i < size; i++) {
+        for (j = i + 1; j < size; j++) {
+            triangle[k] = edges[labels[i] * size + labels[j]];
+            hash = (hash ^ (unsigned long long) (unsigned int) triangle[k]) * 1099511628211ULL;
+            k++;
+        }
+    }
+
+    return hash;
+}
+
+/* return true when copy holds the slot as no writer left it halfway */
+int readSlot(pCacheSlot slot, pCacheSlot copy) {
+    int retry;
+
+    for (retry = 0; retry < CACHE_RETRIES; retry++) {
+        unsigned int before = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+
+        if (before & 1u) {
+            sched_yield();
+            continue;
+        }
+
+        memcpy(copy, slot, sizeof (CacheSlot));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == before) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+int lookupResult(pResultCache c, const int * edges, int size, int * order,
+        int ** walk, int * walkLength) {
+    int labels[CACHE_MAX_NODES];
+    int triangle[CACHE_EDGES];
+    CacheSlot copy;
+    unsigned long long hash;
+    int probe, i;
+
+    if (size < 1 || size > CACHE_MAX_NODES) {
+        __atomic_fetch_add(&c->misses, 1, __ATOMIC_RELAXED);
+        return UNDEFINED;
+    }
+
+    canonicalLabels(edges, size, labels);
+    hash = canonicalKey(edges, size, labels, triangle);
+
+    for (probe = 0; probe < CACHE_PROBES; probe++) {
+        pCacheSlot slot = &c->slots[(hash + probe) % (unsigned long long) c->count];
+        int start;
+
+        if (!readSlot(slot, &copy) || copy.size == 0) {
+            break;
+        }
+
+        if (copy.hash != hash || copy.size != size
+                || memcmp(copy.edges, triangle, sizeof (int) * size * (size - 1) / 2) != 0
+                || copy.walkLength < 1 || copy.walkLength > CACHE_WALK) {
+            continue;
+        }
+
+        /* back to the labels of the caller, both starting from node 0 */
+        for (start = 0; labels[copy.tour[start]] != 0; start++) {
+        }
+        for (i = 0; i < size; i++) {
+            order[i] = labels[copy.tour[(start + i) % size]];
+        }
+        order[size] = order[0];
+
+        *walk = (int*) malloc(sizeof (int) * copy.walkLength);
+
+        if (*walk == NULL) {
+            printf("Error while allocating memory to read result\n");
+            exit(-1);
+        }
+
+        *walkLength = copy.walkLength;
+
+        if (copy.walkLength == 1) {
+            (*walk)[0] = labels[copy.walk[0]];
+        } else {
+            for (start = 0; labels[copy.walk[start]] != 0; start++) {
+            }
+            for (i = 0; i < copy.walkLength - 1; i++) {
+                (*walk)[i] = labels[copy.walk[(start + i) % (copy.walkLength - 1)]];
+            }
+            (*walk)[copy.walkLength - 1] = (*walk)[0];
+        }
+
+        __atomic_fetch_add(&c->hits, 1, __ATOMIC_RELAXED);
+        return copy.weight;
+    }
+
+    __atomic_fetch_add(&c->misses, 1, __ATOMIC_RELAXED);
+    return UNDEFINED;
+}
+
+void storeResult(pResultCache c, const int * edges, int size, const int * order, int weight,
+        const int * walk, int walkLength) {
+    int labels[CACHE_MAX_NODES];
+    int inverse[CACHE_MAX_NODES];
+    int triangle[CACHE_EDGES];
+    unsigned long long hash;
+    pCacheSlot slot = NULL;
+    unsigned int sequence;
+    int probe, i;
+
+    if (size < 1 || size > CACHE_MAX_NODES || walkLength < 1 || walkLength > CACHE_WALK) {
+        return;
+    }
+
+    canonicalLabels(edges, size, labels);
+    hash = canonicalKey(edges, size, labels, triangle);
+
+    for (i = 0; i < size; i++) {
+        inverse[labels[i]] = i;
+    }
+
+    pthread_mutex_lock(&c->lock);
+    flock(c->fd, LOCK_EX);
+
+    /* the first free or equal slot, else one of the probed ones is evicted */
+    for (probe = 0; probe < CACHE_PROBES && slot == NULL; probe++) {
+        pCacheSlot s = &c->slots[(hash + probe) % (unsigned long long) c->count];
+        if (s->size == 0 || (s->hash == hash && s->size == size
+                && memcmp(s->edges, triangle, sizeof (int) * size * (size - 1) / 2) == 0)) {
+            slot = s;
+        }
+    }
+
+    if (slot == NULL) {
+        slot = &c->slots[(hash + (hash >> 32) % CACHE_PROBES) % (unsigned long long) c->count];
+    }
+
+    sequence = slot->sequence;
+    __atomic_store_n(&slot->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    slot->size = size;
+    slot->hash = hash;
+    slot->weight = weight;
+    slot->walkLength = walkLength;
+    memcpy(slot->edges, triangle, sizeof (int) * size * (size - 1) / 2);
+
+    for (i = 0; i <= size; i++) {
+        slot->tour[i] = inverse[order[i]];
+    }
+    for (i = 0; i < walkLength; i++) {
+        slot->walk[i] = inverse[walk[i]];
+    }
+
+    __atomic_store_n(&slot->sequence, sequence + 2, __ATOMIC_RELEASE);
+
+    flock(c->fd, LOCK_UN);
+    pthread_mutex_unlock(&c->lock);
+}
@@ -0,0 +1,43 @@
+#ifndef GUARD_C_MPI_CACHE
+#define GUARD_C_MPI_CACHE
+
+#include "unrank.h"
+
+/* results kept by default in a new store */
+#define CACHE_SLOTS 4096
+/* the instances a store can hold are those the exhaustive search can solve */
+#define CACHE_MAX_NODES UNRANK_MAX_NODES
+
+/*
+ * Optimal tours kept in a file mapped to memory, so they outlive the
+ * process and are shared by every process opening the same file. Each tour
+ * comes with its closed walk over the edges of the graph, up to
+ * CACHE_MAX_NODES * CACHE_MAX_NODES + 1 nodes, so a hit needs no closure.
+ *
+ * An instance is looked up under a canonical labeling of its nodes, sorted
+ * by signatures refined from the weights around them, so relabeled copies of
+ * an instance find each other as long as the refinement tells their nodes
+ * apart. The whole edge matrix under that labeling is compared on a hit,
+ * never only its hash.
+ *
+ * Writers, threads or processes, exclude each other with a lock on the file
+ * and bump a sequence number around every write. Readers take no lock and
+ * retry or miss when the sequence moved under them.
+ */
+typedef struct StructResultCache ResultCache, *pResultCache;
+
+// open the store of path, creating it with room for slots results when it does not exist
+pResultCache openResultCache(const char * path, int slots);
+void closeResultCache(pResultCache cache);
+
+// edges is a symmetric size x size matrix, 0 for a missing edge.
+// return the weight of the cached tour, -1 when there is none. order receives its size + 1
+// nodes from node 0 and *walk the closed walk over the edges of *walkLength nodes (to free)
+int lookupResult(pResultCache cache, const int * edges, int size, int * order,
+        int ** walk, int * walkLength);
+// keep the optimal tour of weight weight over edges and its closed walk over the edges
+void storeResult(pResultCache cache, const int * edges, int size, const int * order, int weight,
+        const int * walk, int walkLength);
+void getResultCacheStats(pResultCache cache, long * hits, long * misses);
+
+#endif
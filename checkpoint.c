@@ -0,0 +1,476 @@
+#include "checkpoint.h"
+
+#define TRUE 1
+#define FALSE 0
+#define UNDEFINED -1
+
+#ifdef USE_MPI_MALLOC
+#include <mpi.h>
+#endif
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Every rank writes its outstanding work units and incumbent to
+ * <dir>/ckpt-<generation>-<rank>.txt. A generation is complete once all the
+ * ranks of the run that produced it have written their file, so a restart
+ * reads the newest complete generation, splits what is left of it evenly
+ * among the current ranks (their count may differ) and writes the next one.
+ * Under MPI rank 0 alone picks that generation, so every rank resumes the
+ * same one even while another run is still writing to dir.
+ */
+
+struct StructCheckpoint {
+    char dir[PATH_MAX];
+    int restart;
+    int interval;
+    int generation;
+
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int writerRunning;
+    int stopping;
+    int dirty;
+
+    /* the search under way, copied to snapshot by the writer */
+    unsigned long hash;
+    int rank;
+    int size;
+    int lower;
+    long long lowerKey;
+    int count;
+    int unit;
+    pWorkUnit units;
+    pWorkUnit snapshot;
+};
+
+static void checkpointPath(pCheckpoint c, char * out, int generation, int rank, const char * suffix);
+static void writeCheckpointFile(pCheckpoint c, pWorkUnit units, int count, int lower, long long lowerKey);
+static int readCheckpointFile(const char * path, unsigned long * hash, int * size,
+        int * lower, long long * lowerKey, pWorkUnit * units, int * count);
+static int latestCompleteGeneration(pCheckpoint c, unsigned long hash, int * maxSeen);
+static int compareUnits(const void * a, const void * b);
+static void * checkpointWriter(void * arg);
+
+pCheckpoint createCheckpoint(const char * dir, int restart, int interval) {
+    pCheckpoint c = (pCheckpoint) malloc(sizeof (Checkpoint));
+
+    if (c == NULL) {
+        printf("Error while allocating memory for checkpoint\n");
+        exit(-1);
+    }
+
+    if (strlen(dir) >= sizeof (c->dir)) {
+        printf("Error while naming checkpoint, %s is too long\n", dir);
+        exit(-1);
+    }
+
+    strcpy(c->dir, dir);
+    c->restart = restart;
+    c->interval = interval > 0 ? interval : CHECKPOINT_INTERVAL;
+    c->generation = 0;
+    c->writerRunning = FALSE;
+    c->stopping = FALSE;
+    c->dirty = FALSE;
+    c->count = 0;
+    c->unit = 0;
+    c->units = NULL;
+    c->snapshot = NULL;
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->wake, NULL);
+
+    return c;
+}
+
+void destroyCheckpoint(pCheckpoint c) {
+    if (c != NULL) {
+        finishCheckpoint(c);
+        pthread_mutex_destroy(&c->lock);
+        pthread_cond_destroy(&c->wake);
+        free(c);
+    }
+}
+
+void checkpointPath(pCheckpoint c, char * out, int generation, int rank, const char * suffix) {
+    int length = snprintf(out, PATH_MAX, "%s/ckpt-%d-%d.txt%s", c->dir, generation, rank, suffix);
+
+    if (length < 0 || length >= PATH_MAX) {
+        printf("Error while naming checkpoint, %s is too long\n", c->dir);
+        exit(-1);
+    }
+}
+
+void writeCheckpointFile(pCheckpoint c, pWorkUnit units, int count, int lower, long long lowerKey) {
+    char path[PATH_MAX];
+    char tmp[PATH_MAX];
+    FILE * f;
+    int i;
+
+    checkpointPath(c, path, c->generation, c->rank, "");
+    checkpointPath(c, tmp, c->generation, c->rank, ".tmp");
+
+    f = fopen(tmp, "w");
+
+    if (f == NULL) {
+        printf("Error while writing checkpoint %s\n", tmp);
+        return;
+    }
+
+    fprintf(f, "hash %lx\n", c->hash);
+    fprintf(f, "ranks %d\n", c->size);
+    fprintf(f, "incumbent %d %lld\n", lower, lowerKey);
+    fprintf(f, "units %d\n", count);
+
+    for (i = 0; i < count; i++) {
+        fprintf(f, "%lld %lld %lld\n", units[i].start, units[i].end, units[i].cursor);
+    }
+
+    fflush(f);
+    fsync(fileno(f));
+    fclose(f);
+
+    if (rename(tmp, path) != 0) {
+        printf("Error while renaming checkpoint %s\n", tmp);
+    }
+}
+
+int readCheckpointFile(const char * path, unsigned long * hash, int * size,
+        int * lower, long long * lowerKey, pWorkUnit * units, int * count) {
+    FILE * f = fopen(path, "r");
+    int i;
+    int ok;
+
+    if (f == NULL) {
+        return FALSE;
+    }
+
+    ok = fscanf(f, "hash %lx\n", hash) == 1
+            && fscanf(f, "ranks %d\n", size) == 1
+            && fscanf(f, "incumbent %d %lld\n", lower, lowerKey) == 2
+            && fscanf(f, "units %d\n", count) == 1
+            && *count >= 0;
+
+    *units = NULL;
+
+    if (ok && *count > 0) {
+        *units = (pWorkUnit) malloc(sizeof (WorkUnit) * *count);
+
+        if (*units == NULL) {
+            printf("Error while allocating memory to read checkpoint\n");
+            exit(-1);
+        }
+
+        for (i = 0; i < *count && ok; i++) {
+            ok = fscanf(f, "%lld %lld %lld\n", &(*units)[i].start, &(*units)[i].end,
+                    &(*units)[i].cursor) == 3;
+        }
+
+        if (!ok) {
+            free(*units);
+            *units = NULL;
+        }
+    }
+
+    fclose(f);
+    return ok;
+}
+
+int latestCompleteGeneration(pCheckpoint c, unsigned long hash, int * maxSeen) {
+    DIR * dir = opendir(c->dir);
+    struct dirent * entry;
+    int generation;
+
+    *maxSeen = -1;
+
+    if (dir == NULL) {
+        return -1;
+    }
+
+    while ((entry = readdir(dir)) != NULL) {
+        int g, r, consumed = 0;
+        if (sscanf(entry->d_name, "ckpt-%d-%d.txt%n", &g, &r, &consumed) == 2
+                && entry->d_name[consumed] == '\0' && g > *maxSeen) {
+            *maxSeen = g;
+        }
+    }
+
+    closedir(dir);
+
+    for (generation = *maxSeen; generation >= 0; generation--) {
+        char path[PATH_MAX];
+        unsigned long h;
+        int size, lower, count, r;
+        long long lowerKey;
+        int complete;
+        pWorkUnit units;
+
+        checkpointPath(c, path, generation, 0, "");
+
+        if (!readCheckpointFile(path, &h, &size, &lower, &lowerKey, &units, &count)) {
+            continue;
+        }
+
+        free(units);
+
+        if (h != hash) {
+            if (c->restart) {
+                printf("Checkpoint %s belongs to another instance\n", path);
+                exit(-1);
+            }
+            continue;
+        }
+
+        complete = TRUE;
+
+        for (r = 1; r < size && complete; r++) {
+            checkpointPath(c, path, generation, r, "");
+            complete = access(path, R_OK) == 0;
+        }
+
+        if (complete) {
+            return generation;
+        }
+    }
+
+    return -1;
+}
+
+int compareUnits(const void * a, const void * b) {
+    long long d = ((const WorkUnit *) a)->start - ((const WorkUnit *) b)->start;
+    return d < 0 ? -1 : d > 0;
+}
+
+int loadCheckpointUnits(pCheckpoint c, unsigned long hash, int rank, int size, long long start,
+        long long end, pWorkUnit * units, int * lower, long long * lowerKey) {
+    int maxSeen;
+    int generation = UNDEFINED;
+
+    if (rank == 0) {
+        generation = latestCompleteGeneration(c, hash, &maxSeen);
+    }
+
+#ifdef USE_MPI_MALLOC
+    /* a rank looking on its own could see a generation completed meanwhile */
+    if (size > 1) {
+        MPI_Bcast(&generation, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    }
+#endif
+
+    *lower = INT_MAX;
+    *lowerKey = -1;
+
+    c->generation = generation + 1;
+
+    if (!c->restart || generation < 0) {
+
+        if (c->restart && rank == 0) {
+            printf("No complete checkpoint in %s, starting from scratch\n", c->dir);
+        }
+
+        *units = (pWorkUnit) malloc(sizeof (WorkUnit));
+
+        if (*units == NULL) {
+            printf("Error while allocating memory for work units\n");
+            exit(-1);
+        }
+
+        (*units)->start = start;
+        (*units)->end = end;
+        (*units)->cursor = start - 1;
+        return 1;
+
+    } else {
+        pWorkUnit remaining = NULL;
+        int nRemaining = 0;
+        int oldSize = 1;
+        int r, i, count = 0;
+        long long total = 0, offset = 0, myBegin, myEnd;
+
+        for (r = 0; r < oldSize; r++) {
+            char path[PATH_MAX];
+            unsigned long h;
+            int l, n;
+            long long k;
+            pWorkUnit read;
+
+            checkpointPath(c, path, generation, r, "");
+
+            if (!readCheckpointFile(path, &h, &oldSize, &l, &k, &read, &n)) {
+                printf("Error while reading checkpoint %s\n", path);
+                exit(-1);
+            }
+
+            if (l < *lower || (l == *lower && k < *lowerKey)) {
+                *lower = l;
+                *lowerKey = k;
+            }
+
+            remaining = (pWorkUnit) realloc(remaining, sizeof (WorkUnit) * (nRemaining + n + 1));
+
+            if (remaining == NULL) {
+                printf("Error while allocating memory for work units\n");
+                exit(-1);
+            }
+
+            for (i = 0; i < n; i++) {
+                if (read[i].cursor < read[i].end) {
+                    remaining[nRemaining].start = read[i].cursor + 1;
+                    remaining[nRemaining].end = read[i].end;
+                    remaining[nRemaining].cursor = read[i].cursor;
+                    total += remaining[nRemaining].end - remaining[nRemaining].start + 1;
+                    nRemaining++;
+                }
+            }
+
+            free(read);
+        }
+
+        if (rank == 0) {
+            printf("Resuming generation %d of %s: %lld indexes left, incumbent %d\n",
+                    generation, c->dir, total, *lower);
+        }
+
+        qsort(remaining, nRemaining, sizeof (WorkUnit), compareUnits);
+
+        myBegin = total * rank / size;
+        myEnd = total * (rank + 1) / size;
+
+        *units = (pWorkUnit) malloc(sizeof (WorkUnit) * (nRemaining + 1));
+
+        if (*units == NULL) {
+            printf("Error while allocating memory for work units\n");
+            exit(-1);
+        }
+
+        for (i = 0; i < nRemaining; i++) {
+            long long len = remaining[i].end - remaining[i].start + 1;
+            long long from = myBegin > offset ? myBegin : offset;
+            long long to = myEnd < offset + len ? myEnd : offset + len;
+
+            if (from < to) {
+                (*units)[count].start = remaining[i].start + (from - offset);
+                (*units)[count].end = remaining[i].start + (to - offset) - 1;
+                (*units)[count].cursor = (*units)[count].start - 1;
+                count++;
+            }
+
+            offset += len;
+        }
+
+        free(remaining);
+        return count;
+    }
+}
+
+void * checkpointWriter(void * arg) {
+    pCheckpoint c = (pCheckpoint) arg;
+
+    pthread_mutex_lock(&c->lock);
+
+    while (!c->stopping) {
+        struct timespec deadline;
+        int rc = 0;
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += c->interval;
+
+        while (!c->stopping && rc != ETIMEDOUT) {
+            rc = pthread_cond_timedwait(&c->wake, &c->lock, &deadline);
+        }
+
+        if (c->dirty && !c->stopping) {
+            int count = c->count;
+            int lower = c->lower;
+            long long lowerKey = c->lowerKey;
+
+            memcpy(c->snapshot, c->units, sizeof (WorkUnit) * count);
+            c->dirty = FALSE;
+
+            pthread_mutex_unlock(&c->lock);
+            writeCheckpointFile(c, c->snapshot, count, lower, lowerKey);
+            pthread_mutex_lock(&c->lock);
+        }
+    }
+
+    pthread_mutex_unlock(&c->lock);
+    return NULL;
+}
+
+void startCheckpoint(pCheckpoint c, unsigned long hash, int rank, int size, pWorkUnit units, int count,
+        int lower, long long lowerKey) {
+
+    c->units = (pWorkUnit) malloc(sizeof (WorkUnit) * (count + 1));
+    c->snapshot = (pWorkUnit) malloc(sizeof (WorkUnit) * (count + 1));
+
+    if (c->units == NULL || c->snapshot == NULL) {
+        printf("Error while allocating memory for checkpoint\n");
+        exit(-1);
+    }
+
+    memcpy(c->units, units, sizeof (WorkUnit) * count);
+    c->hash = hash;
+    c->rank = rank;
+    c->size = size;
+    c->count = count;
+    c->unit = 0;
+    c->lower = lower;
+    c->lowerKey = lowerKey;
+    c->stopping = FALSE;
+    c->dirty = FALSE;
+
+    /* make the new generation complete as soon as possible */
+    writeCheckpointFile(c, c->units, c->count, c->lower, c->lowerKey);
+
+    if (pthread_create(&c->writer, NULL, checkpointWriter, c) != 0) {
+        printf("Error while starting checkpoint writer\n");
+        exit(-1);
+    }
+
+    c->writerRunning = TRUE;
+}
+
+void beginCheckpointUnit(pCheckpoint c, int unit) {
+    pthread_mutex_lock(&c->lock);
+    c->unit = unit;
+    pthread_mutex_unlock(&c->lock);
+}
+
+void updateCheckpoint(pCheckpoint c, long long cursor, int lower, long long lowerKey) {
+    pthread_mutex_lock(&c->lock);
+    c->units[c->unit].cursor = cursor;
+    if (lower < c->lower) {
+        c->lower = lower;
+        c->lowerKey = lowerKey;
+    }
+    c->dirty = TRUE;
+    pthread_mutex_unlock(&c->lock);
+}
+
+void finishCheckpoint(pCheckpoint c) {
+    if (c->writerRunning) {
+        pthread_mutex_lock(&c->lock);
+        c->stopping = TRUE;
+        pthread_cond_signal(&c->wake);
+        pthread_mutex_unlock(&c->lock);
+
+        pthread_join(c->writer, NULL);
+        c->writerRunning = FALSE;
+
+        writeCheckpointFile(c, c->units, c->count, c->lower, c->lowerKey);
+    }
+
+    free(c->units);
+    free(c->snapshot);
+    c->units = NULL;
+    c->snapshot = NULL;
+    c->count = 0;
+}
@@ -0,0 +1,36 @@
+#ifndef GUARD_C_MPI_CHECKPOINT
+#define GUARD_C_MPI_CHECKPOINT
+
+/* seconds between two asynchronous checkpoint writes */
+#define CHECKPOINT_INTERVAL 30
+/* the search loop publishes its cursor every 2^CHECKPOINT_STRIDE_BITS indexes */
+#define CHECKPOINT_STRIDE_BITS 12
+#define CHECKPOINT_MASK ((1 << CHECKPOINT_STRIDE_BITS) - 1)
+
+/* a contiguous range of permutation indexes, cursor is the last one searched */
+typedef struct {
+    long long start;
+    long long end;
+    long long cursor;
+} WorkUnit, *pWorkUnit;
+
+/* the checkpoints of one solver: where they go and the search they follow */
+typedef struct StructCheckpoint Checkpoint, *pCheckpoint;
+
+// write checkpoints to dir every interval seconds (CHECKPOINT_INTERVAL when 0),
+// resuming from it when restart is true
+pCheckpoint createCheckpoint(const char * dir, int restart, int interval);
+void destroyCheckpoint(pCheckpoint checkpoint);
+
+// return the number of units this rank must search, allocated in *units. Every rank of
+// size calls it, rank 0 picking the generation resumed for all of them
+int loadCheckpointUnits(pCheckpoint checkpoint, unsigned long hash, int rank, int size,
+        long long start, long long end, pWorkUnit * units, int * lower, long long * lowerKey);
+
+void startCheckpoint(pCheckpoint checkpoint, unsigned long hash, int rank, int size, pWorkUnit units,
+        int count, int lower, long long lowerKey);
+void beginCheckpointUnit(pCheckpoint checkpoint, int unit);
+void updateCheckpoint(pCheckpoint checkpoint, long long cursor, int lower, long long lowerKey);
+void finishCheckpoint(pCheckpoint checkpoint);
+
+#endif
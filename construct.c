@@ -0,0 +1,836 @@
+#include "construct.h"
+#include "anytime.h"
+#include "batch.h"
+#include "query.h"
+
+#define TRUE 1
+#define FALSE 0
+#define UNDEFINED -1
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+    const int * weights;
+    int size;
+    /* nodes the candidates are searched among, and their count */
+    const int * nodes;
+    int count;
+    /* CONSTRUCT_CANDIDATES nearest nodes of every node of nodes, UNDEFINED past the last */
+    int * candidates;
+    /* component of every node in the current Boruvka round */
+    int * component;
+    /* other end of the lightest edge leaving every node, UNDEFINED for none */
+    int * nearest;
+    /* graph of the instance whose closure rows are filled */
+    pBaseGraph graph;
+    int * closure;
+} Construction, *pConstruction;
+
+typedef struct {
+    pConstruction c;
+    int begin;
+    int end;
+} ConstructTask, *pConstructTask;
+
+typedef struct {
+    int weight;
+    int u;
+    int v;
+} Edge, *pEdge;
+
+static void runTasks(pConstruction c, int count, int threads, void * (*work)(void *));
+static void * findCandidates(void * arg);
+static void * findNearest(void * arg);
+static void * fillClosure(void * arg);
+static int lighterEdge(const int * weights, int size, int a, int b, int x, int y);
+static int compareEdges(const void * a, const void * b);
+static int findSet(int * sets, int v);
+static void linkEnds(int * adjacent, int u, int v);
+static long long cycleWeight(const int * weights, int size, const int * order);
+static void doubleTree(const int * parent, int size, int * order);
+static void christofides(const int * weights, int size, int threads, const int * parent, int * order);
+static void greedyEdge(const int * weights, int size, int threads, int * order);
+static int * closeGraph(pBaseGraph graph, int threads);
+
+/* a single thread runs the work itself */
+void runTasks(pConstruction c, int count, int threads, void * (*work)(void *)) {
+    pConstructTask tasks;
+    pthread_t * workers;
+    int i;
+
+    if (threads <= 1) {
+        ConstructTask task;
+        task.c = c;
+        task.begin = 0;
+        task.end = count;
+        work(&task);
+        return;
+    }
+
+    tasks = (pConstructTask) malloc(sizeof (ConstructTask) * threads);
+    workers = (pthread_t *) malloc(sizeof (pthread_t) * threads);
+
+    if (tasks == NULL || workers == NULL) {
+        printf("Error while allocating memory to start workers\n");
+        exit(-1);
+    }
+
+    for (i = 0; i < threads; i++) {
+        tasks[i].c = c;
+        tasks[i].begin = (int) ((long long) count * i / threads);
+        tasks[i].end = (int) ((long long) count * (i + 1) / threads);
+        if (pthread_create(&workers[i], NULL, work, &tasks[i]) != 0) {
+            printf("Error while starting worker\n");
+            exit(-1);
+        }
+    }
+
+    for (i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    free(tasks);
+    free(workers);
+}
+
+/* the nearest first, kept sorted by insertion as each row is scanned */
+void * findCandidates(void * arg) {
+    pConstructTask t = (pConstructTask) arg;
+    pConstruction c = t->c;
+    int i, j, k;
+
+    for (i = t->begin; i < t->end; i++) {
+        int v = c->nodes[i];
+        const int * row = c->weights + (long long) v * c->size;
+        int * kept = c->candidates + (long long) i * CONSTRUCT_CANDIDATES;
+        int found = 0;
+
+        for (j = 0; j < c->count; j++) {
+            int u = c->nodes[j];
+
+            if (u == v || row[u] == INT_MAX
+                    || (found == CONSTRUCT_CANDIDATES && row[u] >= row[kept[found - 1]])) {
+                continue;
+            }
+
+            if (found < CONSTRUCT_CANDIDATES) {
+                found++;
+            }
+
+            for (k = found - 1; k > 0 && row[kept[k - 1]] > row[u]; k--) {
+                kept[k] = kept[k - 1];
+            }
+
+            kept[k] = u;
+        }
+
+        for (k = found; k < CONSTRUCT_CANDIDATES; k++) {
+            kept[k] = UNDEFINED;
+        }
+    }
+
+    return NULL;
+}
+
+void * findNearest(void * arg) {
+    pConstructTask t = (pConstructTask) arg;
+    pConstruction c = t->c;
+    int v, u;
+
+    for (v = t->begin; v < t->end; v++) {
+        const int * row = c->weights + (long long) v * c->size;
+        int best = UNDEFINED;
+
+        for (u = 0; u < c->size; u++) {
+            if (c->component[u] != c->component[v] && row[u] != INT_MAX
+                    && (best == UNDEFINED || lighterEdge(c->weights, c->size, v, u, v, best))) {
+                best = u;
+            }
+        }
+
+        c->nearest[v] = best;
+    }
+
+    return NULL;
+}
+
+void * fillClosure(void * arg) {
+    pConstructTask t = (pConstructTask) arg;
+    pConstruction c = t->c;
+    pDijkstraScratch scratch = createDijkstraScratch(c->graph);
+    int v;
+
+    for (v = t->begin; v < t->end; v++) {
+        targetDistances(c->graph, scratch, v, c->nodes, c->size, c->closure + (long long) v * c->size);
+    }
+
+    destroyDijkstraScratch(scratch);
+    return NULL;
+}
+
+/* ties broken by the nodes, so every component agrees on the order and no cycle is closed */
+int lighterEdge(const int * weights, int size, int a, int b, int x, int y) {
+    int w = weights[(long long) a * size + b];
+    int z = weights[(long long) x * size + y];
+    int lo = a < b ? a : b, hi = a < b ? b : a;
+    int xlo = x < y ? x : y, xhi = x < y ? y : x;
+
+    if (w != z) {
+        return w < z;
+    }
+    if (lo != xlo) {
+        return lo < xlo;
+    }
+    return hi < xhi;
+}
+
+int compareEdges(const void * a, const void * b) {
+    const Edge * x = (const Edge *) a;
+    const Edge * y = (const Edge *) b;
+    if (x->weight != y->weight) {
+        return x->weight < y->weight ? -1 : 1;
+    }
+    if (x->u != y->u) {
+        return x->u - y->u;
+    }
+    return x->v - y->v;
+}
+
+int findSet(int * sets, int v) {
+    while (sets[v] != v) {
+        sets[v] = sets[sets[v]];
+        v = sets[v];
+    }
+    return v;
+}
+
+long long spanningTree(const int * weights, int size, int threads, int * parent) {
+    Construction c;
+    int * sets = (int*) malloc(sizeof (int) * size);
+    int * cheapest = (int*) malloc(sizeof (int) * size);
+    int * adjacent = (int*) malloc(sizeof (int) * 2 * (size > 1 ? size - 1 : 1));
+    int * first = (int*) malloc(sizeof (int) * size);
+    int * next = (int*) malloc(sizeof (int) * 2 * (size > 1 ? size - 1 : 1));
+    long long total = 0;
+    int components = size;
+    int edges = 0;
+    int v;
+
+    c.weights = weights;
+    c.size = size;
+    c.component = (int*) malloc(sizeof (int) * size);
+    c.nearest = (int*) malloc(sizeof (int) * size);
+
+    if (sets == NULL || cheapest == NULL || adjacent == NULL || first == NULL || next == NULL
+            || c.component == NULL || c.nearest == NULL) {
+        printf("Error while allocating memory to build spanning tree\n");
+        exit(-1);
+    }
+
+    for (v = 0; v < size; v++) {
+        sets[v] = c.component[v] = v;
+        first[v] = UNDEFINED;
+    }
+
+    while (components > 1) {
+        int joined = 0;
+
+        runTasks(&c, size, threads, findNearest);
+
+        /* the lightest edge leaving each component, its root standing for it */
+        for (v = 0; v < size; v++) {
+            cheapest[v] = UNDEFINED;
+        }
+
+        for (v = 0; v < size; v++) {
+            int r = c.component[v];
+            int u = c.nearest[v];
+
+            if (u != UNDEFINED && (cheapest[r] == UNDEFINED
+                    || lighterEdge(weights, size, v, u, cheapest[r], c.nearest[cheapest[r]]))) {
+                cheapest[r] = v;
+            }
+        }
+
+        for (v = 0; v < size; v++) {
+            int a = cheapest[v];
+            int b, ra, rb;
+
+            if (a == UNDEFINED) {
+                continue;
+            }
+
+            b = c.nearest[a];
+            ra = findSet(sets, a);
+            rb = findSet(sets, b);
+
+            if (ra != rb) {
+                sets[ra < rb ? rb : ra] = ra < rb ? ra : rb;
+                total += weights[(long long) a * size + b];
+                adjacent[2 * edges] = b;
+                next[2 * edges] = first[a];
+                first[a] = 2 * edges;
+                adjacent[2 * edges + 1] = a;
+                next[2 * edges + 1] = first[b];
+                first[b] = 2 * edges + 1;
+                edges++;
+                joined++;
+            }
+        }
+
+        if (joined == 0) {
+            break;
+        }
+
+        components -= joined;
+
+        for (v = 0; v < size; v++) {
+            c.component[v] = findSet(sets, v);
+        }
+    }
+
+    /* the tree hangs from node 0, walked breadth first with cheapest as the queue */
+    if (components == 1) {
+        int head = 0, tail = 0;
+
+        for (v = 0; v < size; v++) {
+            parent[v] = UNDEFINED;
+        }
+
+        cheapest[tail++] = 0;
+
+        while (head < tail) {
+            int u = cheapest[head++];
+            int e;
+
+            for (e = first[u]; e != UNDEFINED; e = next[e]) {
+                if (adjacent[e] != parent[u]) {
+                    parent[adjacent[e]] = u;
+                    cheapest[tail++] = adjacent[e];
+                }
+            }
+        }
+    }
+
+    free(sets);
+    free(cheapest);
+    free(adjacent);
+    free(first);
+    free(next);
+    free(c.component);
+    free(c.nearest);
+
+    return components == 1 ? total : UNDEFINED;
+}
+
+/* adjacent holds two neighbors per node, UNDEFINED where there is none yet */
+void linkEnds(int * adjacent, int u, int v) {
+    adjacent[2 * u + (adjacent[2 * u] == UNDEFINED ? 0 : 1)] = v;
+    adjacent[2 * v + (adjacent[2 * v] == UNDEFINED ? 0 : 1)] = u;
+}
+
+long long cycleWeight(const int * weights, int size, const int * order) {
+    long long ret = 0;
+    int i;
+
+    for (i = 0; i < size; i++) {
+        ret += weights[(long long) order[i] * size + order[i + 1]];
+    }
+
+    return ret;
+}
+
+void doubleTree(const int * parent, int size, int * order) {
+    int * first = (int*) malloc(sizeof (int) * size);
+    int * sibling = (int*) malloc(sizeof (int) * size);
+    int * stack = (int*) malloc(sizeof (int) * size);
+    int top = 0, count = 0;
+    int v;
+
+    if (first == NULL || sibling == NULL || stack == NULL) {
+        printf("Error while allocating memory to build tour\n");
+        exit(-1);
+    }
+
+    for (v = 0; v < size; v++) {
+        first[v] = UNDEFINED;
+    }
+
+    for (v = size - 1; v > 0; v--) {
+        sibling[v] = first[parent[v]];
+        first[parent[v]] = v;
+    }
+
+    stack[top++] = 0;
+
+    while (top > 0) {
+        int u = stack[--top];
+
+        order[count++] = u;
+
+        for (v = first[u]; v != UNDEFINED; v = sibling[v]) {
+            stack[top++] = v;
+        }
+    }
+
+    order[size] = 0;
+
+    free(first);
+    free(sibling);
+    free(stack);
+}
+
+/*
+ * The odd nodes are matched taking the pairs among their nearest odd nodes
+ * lightest first, and those left over each to the nearest one left. The
+ * circuit over the tree and the matching is walked by Hierholzer, skipping
+ * the nodes already visited.
+ */
+void christofides(const int * weights, int size, int threads, const int * parent, int * order) {
+    Construction c;
+    int * degree = (int*) calloc(size, sizeof (int));
+    int * odd = (int*) malloc(sizeof (int) * size);
+    int * mate = (int*) malloc(sizeof (int) * size);
+    int * ends = (int*) malloc(sizeof (int) * 4 * size);
+    int * first = (int*) malloc(sizeof (int) * size);
+    int * next = (int*) malloc(sizeof (int) * 4 * size);
+    char * used = (char*) calloc(2 * size, sizeof (char));
+    char * visited = (char*) calloc(size, sizeof (char));
+    int * stack = (int*) malloc(sizeof (int) * (2 * size + 1));
+    pEdge stream;
+    int count = 0, pairs = 0, edges = 0, top = 0, visits = 0;
+    int i, j, v;
+
+    if (degree == NULL || odd == NULL || mate == NULL || ends == NULL || first == NULL
+            || next == NULL || used == NULL || visited == NULL || stack == NULL) {
+        printf("Error while allocating memory to build tour\n");
+        exit(-1);
+    }
+
+    for (v = 1; v < size; v++) {
+        degree[v]++;
+        degree[parent[v]]++;
+    }
+
+    for (v = 0; v < size; v++) {
+        mate[v] = UNDEFINED;
+        first[v] = UNDEFINED;
+        if (degree[v] % 2 == 1) {
+            odd[count++] = v;
+        }
+    }
+
+    c.weights = weights;
+    c.size = size;
+    c.nodes = odd;
+    c.count = count;
+    c.candidates = (int*) malloc(sizeof (int) * ((long long) count * CONSTRUCT_CANDIDATES + 1));
+    stream = (pEdge) malloc(sizeof (Edge) * ((long long) count * CONSTRUCT_CANDIDATES + 1));
+
+    if (c.candidates == NULL || stream == NULL) {
+        printf("Error while allocating memory to build tour\n");
+        exit(-1);
+    }
+
+    runTasks(&c, count, threads, findCandidates);
+
+    for (i = 0; i < count; i++) {
+        for (j = 0; j < CONSTRUCT_CANDIDATES; j++) {
+            int u = c.candidates[i * CONSTRUCT_CANDIDATES + j];
+            if (u != UNDEFINED && odd[i] < u) {
+                stream[pairs].weight = weights[(long long) odd[i] * size + u];
+                stream[pairs].u = odd[i];
+                stream[pairs].v = u;
+                pairs++;
+            }
+        }
+    }
+
+    qsort(stream, pairs, sizeof (Edge), compareEdges);
+
+    for (i = 0; i < pairs; i++) {
+        if (mate[stream[i].u] == UNDEFINED && mate[stream[i].v] == UNDEFINED) {
+            mate[stream[i].u] = stream[i].v;
+            mate[stream[i].v] = stream[i].u;
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        int best = UNDEFINED;
+
+        if (mate[odd[i]] != UNDEFINED) {
+            continue;
+        }
+
+        for (j = i + 1; j < count; j++) {
+            if (mate[odd[j]] == UNDEFINED && (best == UNDEFINED
+                    || weights[(long long) odd[i] * size + odd[j]] < weights[(long long) odd[i] * size + best])) {
+                best = odd[j];
+            }
+        }
+
+        if (best != UNDEFINED) {
+            mate[odd[i]] = best;
+            mate[best] = odd[i];
+        }
+    }
+
+    /* tree and matching edges, each one as two half edges 2e and 2e + 1 */
+    for (v = 0; v < size; v++) {
+        int u = v > 0 ? parent[v] : UNDEFINED;
+        int side;
+
+        for (side = 0; side < 2; side++) {
+            if (u != UNDEFINED) {
+                ends[2 * edges] = u;
+                next[2 * edges] = first[v];
+                first[v] = 2 * edges;
+                ends[2 * edges + 1] = v;
+                next[2 * edges + 1] = first[u];
+                first[u] = 2 * edges + 1;
+                edges++;
+            }
+            u = mate[v] > v ? mate[v] : UNDEFINED;
+        }
+    }
+
+    stack[top++] = 0;
+
+    while (top > 0) {
+        int u = stack[top - 1];
+
+        while (first[u] != UNDEFINED && used[first[u] / 2]) {
+            first[u] = next[first[u]];
+        }
+
+        if (first[u] == UNDEFINED) {
+            top--;
+            if (!visited[u]) {
+                visited[u] = TRUE;
+                order[visits++] = u;
+            }
+        } else {
+            used[first[u] / 2] = TRUE;
+            stack[top++] = ends[first[u]];
+        }
+    }
+
+    /* the circuit came out backwards from node 0, which is fine for a symmetric tour */
+    order[size] = 0;
+
+    free(degree);
+    free(odd);
+    free(mate);
+    free(ends);
+    free(first);
+    free(next);
+    free(used);
+    free(visited);
+    free(stack);
+    free(c.candidates);
+    free(stream);
+}
+
+void greedyEdge(const int * weights, int size, int threads, int * order) {
+    Construction c;
+    int * nodes = (int*) malloc(sizeof (int) * size);
+    int * sets = (int*) malloc(sizeof (int) * size);
+    int * adjacent = (int*) malloc(sizeof (int) * 2 * size);
+    int * degree = (int*) calloc(size, sizeof (int));
+    int * ends = (int*) malloc(sizeof (int) * size);
+    char * taken = (char*) calloc(size, sizeof (char));
+    pEdge stream = (pEdge) malloc(sizeof (Edge) * ((long long) size * CONSTRUCT_CANDIDATES + 1));
+    int * chain = (int*) malloc(sizeof (int) * size);
+    int pairs = 0, count = 0, visits;
+    int i, j, v, start, tail;
+
+    c.candidates = (int*) malloc(sizeof (int) * ((long long) size * CONSTRUCT_CANDIDATES + 1));
+
+    if (nodes == NULL || sets == NULL || adjacent == NULL || degree == NULL || ends == NULL
+            || taken == NULL || stream == NULL || chain == NULL || c.candidates == NULL) {
+        printf("Error while allocating memory to build tour\n");
+        exit(-1);
+    }
+
+    for (v = 0; v < size; v++) {
+        nodes[v] = sets[v] = v;
+        adjacent[2 * v] = adjacent[2 * v + 1] = UNDEFINED;
+    }
+
+    c.weights = weights;
+    c.size = size;
+    c.nodes = nodes;
+    c.count = size;
+
+    runTasks(&c, size, threads, findCandidates);
+
+    /* both ends may offer the same edge, kept once as u < v */
+    for (v = 0; v < size; v++) {
+        for (j = 0; j < CONSTRUCT_CANDIDATES; j++) {
+            int u = c.candidates[v * CONSTRUCT_CANDIDATES + j];
+            if (u != UNDEFINED) {
+                stream[pairs].weight = weights[(long long) v * size + u];
+                stream[pairs].u = v < u ? v : u;
+                stream[pairs].v = v < u ? u : v;
+                pairs++;
+            }
+        }
+    }
+
+    qsort(stream, pairs, sizeof (Edge), compareEdges);
+
+    for (i = 0; i < pairs; i++) {
+        int u = stream[i].u;
+        int w = stream[i].v;
+        int ru, rw;
+
+        if ((i > 0 && u == stream[i - 1].u && w == stream[i - 1].v) || degree[u] == 2 || degree[w] == 2) {
+            continue;
+        }
+
+        ru = findSet(sets, u);
+        rw = findSet(sets, w);
+
+        if (ru != rw) {
+            sets[ru] = rw;
+            linkEnds(adjacent, u, w);
+            degree[u]++;
+            degree[w]++;
+        }
+    }
+
+    /* the paths left, a lone node being a path of one, are chained by their nearest ends */
+    for (v = 0; v < size; v++) {
+        if (degree[v] < 2) {
+            ends[count++] = v;
+        }
+    }
+
+    tail = ends[0];
+    visits = 0;
+
+    while (tail != UNDEFINED) {
+        int previous = UNDEFINED;
+        int best = UNDEFINED;
+
+        taken[findSet(sets, tail)] = TRUE;
+
+        for (v = tail; v != UNDEFINED;) {
+            int step = adjacent[2 * v] != previous ? adjacent[2 * v] : adjacent[2 * v + 1];
+            chain[visits++] = v;
+            previous = v;
+            v = step;
+        }
+
+        tail = chain[visits - 1];
+
+        for (i = 0; i < count; i++) {
+            int u = ends[i];
+            if (!taken[findSet(sets, u)] && (best == UNDEFINED
+                    || weights[(long long) tail * size + u] < weights[(long long) tail * size + best])) {
+                best = u;
+            }
+        }
+
+        tail = best;
+    }
+
+    for (start = 0; chain[start] != 0; start++) {
+    }
+
+    for (i = 0; i < size; i++) {
+        order[i] = chain[(start + i) % size];
+    }
+
+    order[size] = 0;
+
+    free(nodes);
+    free(sets);
+    free(adjacent);
+    free(degree);
+    free(ends);
+    free(taken);
+    free(chain);
+    free(stream);
+    free(c.candidates);
+}
+
+long long constructTour(const int * weights, int size, int method, int threads, int * order,
+        long long * bound) {
+    int * parent;
+    long long tree;
+    int i;
+
+    if (size < 1) {
+        return UNDEFINED;
+    }
+
+    parent = (int*) malloc(sizeof (int) * size);
+
+    if (parent == NULL) {
+        printf("Error while allocating memory to build tour\n");
+        exit(-1);
+    }
+
+    tree = spanningTree(weights, size, threads < 1 ? 1 : threads, parent);
+    *bound = tree;
+
+    if (tree < 0) {
+        free(parent);
+        return UNDEFINED;
+    }
+
+    if (size <= 3) {
+        /* every order is the same tour */
+        for (i = 0; i < size; i++) {
+            order[i] = i;
+        }
+        order[size] = 0;
+    } else if (method == CONSTRUCT_DOUBLE_TREE) {
+        doubleTree(parent, size, order);
+    } else if (method == CONSTRUCT_CHRISTOFIDES) {
+        christofides(weights, size, threads < 1 ? 1 : threads, parent, order);
+    } else {
+        greedyEdge(weights, size, threads < 1 ? 1 : threads, order);
+    }
+
+    free(parent);
+    return cycleWeight(weights, size, order);
+}
+
+/* the tour runs over the shortest paths between the nodes, a row per thread task, to free */
+int * closeGraph(pBaseGraph graph, int threads) {
+    Construction c;
+    int * nodes;
+    int size = getBaseGraphSize(graph);
+    int i;
+
+    c.graph = graph;
+    c.size = size;
+    c.closure = (int*) malloc(sizeof (int) * (long long) size * size);
+    nodes = (int*) malloc(sizeof (int) * size);
+
+    if (c.closure == NULL || nodes == NULL) {
+        printf("Error while allocating memory to build tour\n");
+        exit(-1);
+    }
+
+    for (i = 0; i < size; i++) {
+        nodes[i] = i;
+    }
+
+    c.nodes = nodes;
+    c.count = size;
+    runTasks(&c, size, threads, fillClosure);
+
+    free(nodes);
+    return c.closure;
+}
+
+long long improveTour(pBaseGraph graph, int method, int threads, double seconds, int * tour,
+        long long * bound) {
+    int size = getBaseGraphSize(graph);
+    int * closure = closeGraph(graph, threads);
+    long long weight = constructTour(closure, size, method, threads, tour, bound);
+
+    /* the anytime threads keep int weights */
+    if (weight >= 0 && weight < INT_MAX && seconds > 0 && size > 2) {
+        pAnytime a = startAnytime(closure, size, tour, (int) weight, (int) *bound, seconds);
+        int lower;
+
+        waitAnytime(a);
+        weight = stopAnytime(a, tour, &lower);
+        *bound = lower;
+    }
+
+    free(closure);
+    return weight;
+}
+
+void runConstruction(const char * input, const char * output, int method, int threads) {
+    Instance instance;
+    pBaseGraph graph;
+    FILE * in = strcmp(input, "-") == 0 ? stdin : fopen(input, "r");
+    FILE * out;
+    int * tour;
+    long long weight, bound;
+    int i;
+    struct timespec start, now;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    if (in == NULL || !readInstance(in, &instance)) {
+        printf("Error while reading instance from %s\n", input);
+        exit(-1);
+    }
+
+    if (in != stdin) {
+        fclose(in);
+    }
+
+    if (instance.size < 1) {
+        printf("Error while reading instance from %s\n", input);
+        exit(-1);
+    }
+
+    graph = createBaseGraph(instance.size, 1);
+
+    for (i = 0; i < instance.count; i++) {
+        int src = instance.edges[3 * i];
+        int dst = instance.edges[3 * i + 1];
+        if (src >= 0 && dst >= 0 && src < instance.size && dst < instance.size) {
+            addBaseEdge(graph, src, dst, instance.edges[3 * i + 2]);
+        }
+    }
+
+    tour = (int*) malloc(sizeof (int) * (instance.size + 1));
+
+    if (tour == NULL) {
+        printf("Error while allocating memory to build tour\n");
+        exit(-1);
+    }
+
+    weight = improveTour(graph, method, threads, 0, tour, &bound);
+
+    out = output == NULL ? stdout : fopen(output, "w");
+
+    if (out == NULL) {
+        printf("Error while opening %s\n", output);
+        exit(-1);
+    }
+
+    if (weight < 0) {
+        fprintf(out, "%s error\n", instance.id);
+    } else {
+        fprintf(out, "%s %lld", instance.id, weight);
+        for (i = 0; i <= instance.size; i++) {
+            fprintf(out, " %d", tour[i]);
+        }
+        fprintf(out, " bound %lld\n", bound);
+    }
+
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (weight >= 0) {
+        fprintf(stderr, "Built a tour of %d nodes in %.3f seconds, at most %.1f%% over the optimum\n",
+                instance.size, (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9,
+                bound > 0 ? 100.0 * (weight - bound) / bound : 0.0);
+    }
+
+    free(tour);
+    destroyBaseGraph(graph);
+    destroyInstance(&instance);
+}
@@ -0,0 +1,44 @@
+#ifndef GUARD_C_MPI_CONSTRUCT
+#define GUARD_C_MPI_CONSTRUCT
+
+#include "query.h"
+
+/* tour built by constructTour */
+#define CONSTRUCT_DOUBLE_TREE 0
+#define CONSTRUCT_CHRISTOFIDES 1
+#define CONSTRUCT_GREEDY_EDGE 2
+/* nearest nodes each node offers to the greedy edge stream and to the matching */
+#define CONSTRUCT_CANDIDATES 10
+
+/*
+ * Tours built in one pass over the closure of an instance, for a first
+ * incumbent and a gap estimate at any size. The minimum spanning tree is
+ * grown by Boruvka rounds, the threads finding the lightest edge leaving
+ * every node, and its weight bounds every tour from below.
+ *
+ * The double tree tour visits the tree depth first. Christofides joins the
+ * odd nodes of the tree by a greedy matching and shortcuts an Euler circuit
+ * of both. The greedy edge tour takes the edges towards the nearest nodes
+ * of every node, lightest first, whenever they keep paths, tracked by a
+ * union-find, and chains the paths left by their nearest ends.
+ */
+
+// weights is a symmetric size x size matrix, INT_MAX where there is no path.
+// return the weight of the minimum spanning tree, -1 when the graph is not connected,
+// parent receives the node before each node from node 0 (-1 for node 0)
+long long spanningTree(const int * weights, int size, int threads, int * parent);
+// return the weight of the tour built by method, -1 when there is none, order receives its
+// size + 1 nodes from node 0 and *bound the weight of the minimum spanning tree
+long long constructTour(const int * weights, int size, int method, int threads, int * order,
+        long long * bound);
+// return the weight of a tour over graph built by method over its closure and improved by the
+// anytime search for seconds (0 for none), -1 when there is none. tour receives its size + 1
+// nodes from node 0 and *bound the lower bound proven for it
+long long improveTour(pBaseGraph graph, int method, int threads, double seconds, int * tour,
+        long long * bound);
+
+// build a tour over the graph of the first instance of input ("-" for stdin), writing
+// "<id> <weight> <node> ... <node> bound <weight>" to output (NULL for stdout)
+void runConstruction(const char * input, const char * output, int method, int threads);
+
+#endif
@@ -0,0 +1,950 @@
+#include "decompose.h"
+#include "graph.h"
+#include "batch.h"
+#include "localsearch.h"
+#include "unrank.h"
+
+#define TRUE 1
+#define FALSE 0
+#define UNDEFINED -1
+
+#ifdef USE_MPI_MALLOC
+#include <mpi.h>
+#endif
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* stands for unreachable nodes, small enough for 2-opt to add a few */
+#define DECOMPOSE_FAR (INT_MAX / 8)
+/* k-medoids rounds after the bisection */
+#define DECOMPOSE_ROUNDS 3
+/* members a medoid is estimated from */
+#define DECOMPOSE_SAMPLE 8
+
+typedef struct {
+    pBaseGraph graph;
+    int size;
+    int threads;
+    int rank;
+    int ranks;
+    /* the nodes, reordered so every cluster is a range of them */
+    int * nodes;
+    /* the ranges being split, and where each one was split */
+    int * segments;
+    int * splits;
+    int segmentCount;
+    /* clusters + 1 starts of the clusters in nodes */
+    int * starts;
+    int clusters;
+    /*
+     * The tour of every cluster over its range, cycleWeights[i] being the
+     * weight from cycle[i] to the next node of the same cluster.
+     */
+    int * cycle;
+    int * cycleWeights;
+    int * medoids;
+    /* clusters x clusters */
+    int * medoidDistances;
+    int * tour;
+    /* start of the windows polished in a round */
+    int * windows;
+    int * legs;
+    /* one per thread, the searches of a task reuse the scratch of its thread */
+    pDijkstraScratch * scratches;
+} Decomposition, *pDecomposition;
+
+typedef void (*DecompositionTask)(pDecomposition d, pDijkstraScratch scratch, int index);
+
+typedef struct {
+    pDecomposition d;
+    DecompositionTask task;
+    int next;
+    int end;
+    /* workers started so far, each taking the scratch of its rank among them */
+    int joined;
+    pthread_mutex_t lock;
+} ParallelRun, *pParallelRun;
+
+typedef struct {
+    long long key;
+    int node;
+} SortedNode;
+
+static void * parallelWorker(void * arg);
+static void runParallel(pDecomposition d, DecompositionTask task, int begin, int end);
+static void distancesTo(pDecomposition d, pDijkstraScratch scratch, int src, const int * targets,
+        int count, int * out);
+static int compareSortedNodes(const void * a, const void * b);
+static void bisectSegment(pDecomposition d, pDijkstraScratch scratch, int index);
+static void pushSegment(pDecomposition d, int * segments, int * count, int lo, int hi);
+static void clusterNodes(pDecomposition d);
+static void chooseMedoid(pDecomposition d, pDijkstraScratch scratch, int index);
+static void refineClusters(pDecomposition d);
+static void solveCluster(pDecomposition d, pDijkstraScratch scratch, int index);
+static void measureMedoids(pDecomposition d, pDijkstraScratch scratch, int index);
+static void orderClusters(pDecomposition d, int * order);
+static void stitchClusters(pDecomposition d, const int * order, int * boundaries);
+static void polishWindow(pDecomposition d, pDijkstraScratch scratch, int index);
+static void measureLeg(pDecomposition d, pDijkstraScratch scratch, int index);
+#ifdef USE_MPI_MALLOC
+static void shareClusters(pDecomposition d, int * data, const int * offsets);
+#endif
+
+void * parallelWorker(void * arg) {
+    pParallelRun run = (pParallelRun) arg;
+    pDijkstraScratch scratch;
+
+    pthread_mutex_lock(&run->lock);
+    scratch = run->d->scratches[run->joined++];
+    pthread_mutex_unlock(&run->lock);
+
+    for (;;) {
+        int i;
+
+        pthread_mutex_lock(&run->lock);
+        i = run->next++;
+        pthread_mutex_unlock(&run->lock);
+
+        if (i >= run->end) {
+            break;
+        }
+
+        run->task(run->d, scratch, i);
+    }
+
+    return NULL;
+}
+
+/* run task over begin .. end - 1 from the threads of the decomposition */
+void runParallel(pDecomposition d, DecompositionTask task, int begin, int end) {
+    ParallelRun run;
+    pthread_t * workers;
+    int threads = d->threads < end - begin ? d->threads : end - begin;
+    int i;
+
+    if (threads <= 1) {
+        for (i = begin; i < end; i++) {
+            task(d, d->scratches[0], i);
+        }
+        return;
+    }
+
+    run.d = d;
+    run.task = task;
+    run.next = begin;
+    run.end = end;
+    run.joined = 0;
+    pthread_mutex_init(&run.lock, NULL);
+
+    workers = (pthread_t*) malloc(sizeof (pthread_t) * threads);
+
+    if (workers == NULL) {
+        printf("Error while allocating memory for workers\n");
+        exit(-1);
+    }
+
+    for (i = 0; i < threads; i++) {
+        if (pthread_create(&workers[i], NULL, parallelWorker, &run) != 0) {
+            printf("Error while starting worker\n");
+            exit(-1);
+        }
+    }
+
+    for (i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    free(workers);
+    pthread_mutex_destroy(&run.lock);
+}
+
+/* out[i] receives the distance from src to targets[i] */
+void distancesTo(pDecomposition d, pDijkstraScratch scratch, int src, const int * targets,
+        int count, int * out) {
+    targetDistances(d->graph, scratch, src, targets, count, out);
+}
+
+int compareSortedNodes(const void * a, const void * b) {
+    const SortedNode * x = (const SortedNode *) a;
+    const SortedNode * y = (const SortedNode *) b;
+    if (x->key != y->key) {
+        return x->key < y->key ? -1 : 1;
+    }
+    return x->node - y->node;
+}
+
+/*
+ * The two ends of the segment are found as the farthest node from its first
+ * one and the farthest from that, and the segment is halved by which end
+ * each node is nearer to.
+ */
+void bisectSegment(pDecomposition d, pDijkstraScratch scratch, int index) {
+    int lo = d->segments[2 * index];
+    int hi = d->segments[2 * index + 1];
+    int count = hi - lo;
+    int * members = d->nodes + lo;
+    int * fromP = (int*) malloc(sizeof (int) * count);
+    int * fromQ = (int*) malloc(sizeof (int) * count);
+    SortedNode * sorted = (SortedNode *) malloc(sizeof (SortedNode) * count);
+    int p, q, i;
+
+    if (fromP == NULL || fromQ == NULL || sorted == NULL) {
+        printf("Error while allocating memory to cluster graph\n");
+        exit(-1);
+    }
+
+    distancesTo(d, scratch, members[0], members, count, fromP);
+    for (i = 1, p = 0; i < count; i++) {
+        if (fromP[i] > fromP[p]) {
+            p = i;
+        }
+    }
+
+    distancesTo(d, scratch, members[p], members, count, fromP);
+    for (i = 1, q = 0; i < count; i++) {
+        if (fromP[i] > fromP[q]) {
+            q = i;
+        }
+    }
+
+    distancesTo(d, scratch, members[q], members, count, fromQ);
+
+    for (i = 0; i < count; i++) {
+        sorted[i].key = (long long) fromP[i] - fromQ[i];
+        sorted[i].node = members[i];
+    }
+
+    qsort(sorted, count, sizeof (SortedNode), compareSortedNodes);
+
+    for (i = 0; i < count; i++) {
+        members[i] = sorted[i].node;
+    }
+
+    d->splits[index] = lo + count / 2;
+
+    free(fromP);
+    free(fromQ);
+    free(sorted);
+}
+
+/* a range small enough is a cluster, marked by its start, others are split further */
+void pushSegment(pDecomposition d, int * segments, int * count, int lo, int hi) {
+    if (hi - lo <= DECOMPOSE_CLUSTER_SIZE) {
+        d->starts[lo] = lo;
+    } else {
+        segments[2 * *count] = lo;
+        segments[2 * *count + 1] = hi;
+        (*count)++;
+    }
+}
+
+/* halve every segment larger than a cluster, a level of the bisection at a time */
+void clusterNodes(pDecomposition d) {
+    int * next = (int*) malloc(sizeof (int) * 2 * d->size);
+    int i;
+
+    d->segments = (int*) malloc(sizeof (int) * 2 * d->size);
+    d->splits = (int*) malloc(sizeof (int) * d->size);
+    d->starts = (int*) malloc(sizeof (int) * (d->size + 1));
+
+    if (next == NULL || d->segments == NULL || d->splits == NULL || d->starts == NULL) {
+        printf("Error while allocating memory to cluster graph\n");
+        exit(-1);
+    }
+
+    for (i = 0; i < d->size; i++) {
+        d->nodes[i] = i;
+        d->starts[i] = UNDEFINED;
+    }
+
+    d->segmentCount = 0;
+    pushSegment(d, d->segments, &d->segmentCount, 0, d->size);
+
+    while (d->segmentCount > 0) {
+        int nextCount = 0;
+        int * t;
+
+        runParallel(d, bisectSegment, 0, d->segmentCount);
+
+        for (i = 0; i < d->segmentCount; i++) {
+            pushSegment(d, next, &nextCount, d->segments[2 * i], d->splits[i]);
+            pushSegment(d, next, &nextCount, d->splits[i], d->segments[2 * i + 1]);
+        }
+
+        t = d->segments;
+        d->segments = next;
+        next = t;
+        d->segmentCount = nextCount;
+    }
+
+    /* the ranges nest, so their starts in order give the leaves of the bisection */
+    for (i = 0, d->clusters = 0; i < d->size; i++) {
+        if (d->starts[i] != UNDEFINED) {
+            d->starts[d->clusters++] = i;
+        }
+    }
+
+    d->starts[d->clusters] = d->size;
+
+    free(next);
+}
+
+/* the member nearest to a sample of the others */
+void chooseMedoid(pDecomposition d, pDijkstraScratch scratch, int index) {
+    int lo = d->starts[index];
+    int count = d->starts[index + 1] - lo;
+    int * members = d->nodes + lo;
+    int samples = count < DECOMPOSE_SAMPLE ? count : DECOMPOSE_SAMPLE;
+    long long * sums = (long long *) calloc(count, sizeof (long long));
+    int * row = (int*) malloc(sizeof (int) * count);
+    int best = 0;
+    int i, j;
+
+    if (sums == NULL || row == NULL) {
+        printf("Error while allocating memory to cluster graph\n");
+        exit(-1);
+    }
+
+    for (i = 0; i < samples; i++) {
+        distancesTo(d, scratch, members[(long long) i * count / samples], members, count, row);
+        for (j = 0; j < count; j++) {
+            sums[j] += row[j] == INT_MAX ? DECOMPOSE_FAR : row[j];
+        }
+    }
+
+    for (j = 1; j < count; j++) {
+        if (sums[j] < sums[best]) {
+            best = j;
+        }
+    }
+
+    d->medoids[index] = members[best];
+
+    free(sums);
+    free(row);
+}
+
+/*
+ * The bisection balances the clusters but may cut across them, so every
+ * node then joins its nearest medoid, found for all the nodes by a single
+ * dijkstra from every medoid together, and the medoids are chosen again.
+ */
+void refineClusters(pDecomposition d) {
+    int * dist = (int*) malloc(sizeof (int) * d->size);
+    int * owner = (int*) malloc(sizeof (int) * d->size);
+    int * cluster = (int*) malloc(sizeof (int) * d->size);
+    int * counts = (int*) malloc(sizeof (int) * (d->clusters + 1));
+    int round, c, i;
+
+    if (dist == NULL || owner == NULL || cluster == NULL || counts == NULL) {
+        printf("Error while allocating memory to cluster graph\n");
+        exit(-1);
+    }
+
+    for (round = 0; round < DECOMPOSE_ROUNDS; round++) {
+        int k = d->clusters;
+
+        runParallel(d, chooseMedoid, 0, k);
+        nearestSources(d->graph, d->medoids, k, dist, owner);
+
+        for (c = 0; c < k; c++) {
+            for (i = d->starts[c]; i < d->starts[c + 1]; i++) {
+                cluster[d->nodes[i]] = c;
+            }
+            counts[c] = 0;
+        }
+
+        /* nodes no medoid reaches stay where they were */
+        for (i = 0; i < d->size; i++) {
+            if (owner[i] == UNDEFINED) {
+                owner[i] = cluster[i];
+            }
+            counts[owner[i]]++;
+        }
+
+        /* clusters keep the order of their medoids, the emptied ones are dropped */
+        for (c = 0, d->clusters = 0, d->starts[0] = 0; c < k; c++) {
+            if (counts[c] > 0) {
+                cluster[c] = d->clusters;
+                d->medoids[d->clusters] = d->medoids[c];
+                d->starts[d->clusters + 1] = d->starts[d->clusters] + counts[c];
+                counts[c] = d->starts[d->clusters];
+                d->clusters++;
+            }
+        }
+
+        for (i = 0; i < d->size; i++) {
+            d->nodes[counts[owner[i]]++] = i;
+        }
+    }
+
+    free(dist);
+    free(owner);
+    free(cluster);
+    free(counts);
+}
+
+/* the tour of a cluster over the distances between its nodes, and its medoid */
+void solveCluster(pDecomposition d, pDijkstraScratch scratch, int index) {
+    int lo = d->starts[index];
+    int count = d->starts[index + 1] - lo;
+    int * members = d->nodes + lo;
+    int * dist = (int*) malloc(sizeof (int) * count * count);
+    int * order = (int*) malloc(sizeof (int) * (count + 1));
+    long long best = -1;
+    int i, j;
+
+    if (dist == NULL || order == NULL) {
+        printf("Error while allocating memory to solve cluster\n");
+        exit(-1);
+    }
+
+    for (i = 0; i < count; i++) {
+        distancesTo(d, scratch, members[i], members, count, dist + i * count);
+        for (j = 0; j < count; j++) {
+            if (dist[i * count + j] == INT_MAX) {
+                dist[i * count + j] = DECOMPOSE_FAR;
+            }
+        }
+    }
+
+    for (i = 0; i <= count; i++) {
+        order[i] = i % count;
+    }
+
+    if (count > DECOMPOSE_EXACT_SIZE) {
+        nearestNeighbor(dist, count, order);
+        twoOpt(dist, count, order);
+    } else if (count > 3) {
+        /* any order is the best one up to three nodes */
+        pSolver solver = createLocalSolver(count);
+
+        for (i = 0; i < count; i++) {
+            for (j = i + 1; j < count; j++) {
+                addSolverEdge(solver, i, j, dist[i * count + j]);
+            }
+        }
+
+        solve(solver);
+
+        if (getSolverTour(solver, order) < 0) {
+            for (i = 0; i <= count; i++) {
+                order[i] = i % count;
+            }
+        }
+
+        destroySolver(solver);
+    }
+
+    for (i = 0; i < count; i++) {
+        d->cycle[lo + i] = members[order[i]];
+        d->cycleWeights[lo + i] = dist[order[i] * count + order[i + 1]];
+    }
+
+    for (i = 0; i < count; i++) {
+        long long sum = 0;
+        for (j = 0; j < count; j++) {
+            sum += dist[i * count + j];
+        }
+        if (best < 0 || sum < best) {
+            best = sum;
+            d->medoids[index] = members[i];
+        }
+    }
+
+    free(dist);
+    free(order);
+}
+
+void measureMedoids(pDecomposition d, pDijkstraScratch scratch, int index) {
+    int k = d->clusters;
+    int * row = d->medoidDistances + (long long) index * k;
+    int i;
+
+    distancesTo(d, scratch, d->medoids[index], d->medoids, k, row);
+
+    for (i = 0; i < k; i++) {
+        if (row[i] == INT_MAX) {
+            row[i] = DECOMPOSE_FAR;
+        }
+    }
+}
+
+/* the tour of the medoids, exact when it is small enough, else 2-opt from the bisection order */
+void orderClusters(pDecomposition d, int * order) {
+    int k = d->clusters;
+    int i, j;
+
+    for (i = 0; i <= k; i++) {
+        order[i] = i % k;
+    }
+
+    if (k > 3 && k <= DECOMPOSE_EXACT_SIZE) {
+        pSolver solver = createSolver(k);
+
+        for (i = 0; i < k; i++) {
+            for (j = i + 1; j < k; j++) {
+                addSolverEdge(solver, i, j, d->medoidDistances[i * k + j]);
+            }
+        }
+
+        solve(solver);
+        getSolverTour(solver, order);
+        destroySolver(solver);
+    } else if (k > 3) {
+        twoOpt(d->medoidDistances, k, order);
+    }
+}
+
+/*
+ * Every cluster tour is opened at the edge that makes the cheapest joint
+ * with the end of the previous cluster, walked either way. The first one is
+ * opened at its dearest edge.
+ */
+void stitchClusters(pDecomposition d, const int * order, int * boundaries) {
+    int * dist = (int*) malloc(sizeof (int) * d->size);
+    int pos = 0;
+    int c, i;
+
+    if (dist == NULL) {
+        printf("Error while allocating memory to stitch clusters\n");
+        exit(-1);
+    }
+
+    for (c = 0; c < d->clusters; c++) {
+        int lo = d->starts[order[c]];
+        int count = d->starts[order[c] + 1] - lo;
+        int * cycle = d->cycle + lo;
+        int * weights = d->cycleWeights + lo;
+        long long best = 0;
+        int entry = 0;
+        int step = 1;
+
+        if (c == 0) {
+            for (i = 0; i < count; i++) {
+                if (weights[i] > best) {
+                    best = weights[i];
+                    entry = (i + 1) % count;
+                }
+            }
+        } else {
+            distancesTo(d, d->scratches[0], d->tour[pos - 1], cycle, count, dist);
+            best = LLONG_MAX;
+
+            /* dropping the edge from i to i + 1, entering at either of them */
+            for (i = 0; i < count; i++) {
+                int next = (i + 1) % count;
+                long long forwards = (long long) dist[next] - weights[i];
+                long long backwards = (long long) dist[i] - weights[i];
+
+                if (forwards < best) {
+                    best = forwards;
+                    entry = next;
+                    step = 1;
+                }
+                if (backwards < best) {
+                    best = backwards;
+                    entry = i;
+                    step = count - 1;
+                }
+            }
+        }
+
+        boundaries[c] = pos;
+
+        for (i = 0; i < count; i++) {
+            d->tour[pos++] = cycle[(entry + i * step) % count];
+        }
+    }
+
+    d->tour[pos] = d->tour[0];
+    free(dist);
+}
+
+/*
+ * The nodes around a joint form a path with fixed ends. 2-opt only reads the
+ * first node of a tour as a source and its last as a destination, so the
+ * path is handed over as a tour of its inner nodes and one more: row 0 holds
+ * the distances from the first node and column 0 those to the last one.
+ */
+void polishWindow(pDecomposition d, pDijkstraScratch scratch, int index) {
+    int lo = d->windows[index] - DECOMPOSE_WINDOW;
+    int hi = d->windows[index] + DECOMPOSE_WINDOW;
+    int order[2 * DECOMPOSE_WINDOW + 1];
+    int path[2 * DECOMPOSE_WINDOW + 1];
+    int * weights;
+    int * row;
+    int * nodes;
+    int count, i, j;
+
+    lo = lo < 0 ? 0 : lo;
+    hi = hi > d->size ? d->size : hi;
+    count = hi - lo;
+    nodes = d->tour + lo;
+
+    if (count < 3 || count >= d->size) {
+        return;
+    }
+
+    weights = (int*) malloc(sizeof (int) * count * count);
+    row = (int*) malloc(sizeof (int) * count);
+
+    if (weights == NULL || row == NULL) {
+        printf("Error while allocating memory to polish tour\n");
+        exit(-1);
+    }
+
+    for (i = 0; i < count; i++) {
+        distancesTo(d, scratch, nodes[i], nodes + 1, count, row);
+        for (j = 1; j <= count; j++) {
+            int w = row[j - 1] == INT_MAX ? DECOMPOSE_FAR : row[j - 1];
+            weights[i * count + j % count] = w;
+        }
+    }
+
+    for (i = 0; i <= count; i++) {
+        order[i] = i % count;
+    }
+
+    twoOpt(weights, count, order);
+
+    for (i = 1; i < count; i++) {
+        path[i] = nodes[order[i]];
+    }
+    for (i = 1; i < count; i++) {
+        nodes[i] = path[i];
+    }
+
+    free(weights);
+    free(row);
+}
+
+void measureLeg(pDecomposition d, pDijkstraScratch scratch, int index) {
+    distancesTo(d, scratch, d->tour[index], d->tour + index + 1, 1, d->legs + index);
+}
+
+#ifdef USE_MPI_MALLOC
+/* the data of cluster c lies at offsets[c], every rank filled its own block of clusters */
+void shareClusters(pDecomposition d, int * data, const int * offsets) {
+    int * counts = (int*) malloc(sizeof (int) * d->ranks);
+    int * displs = (int*) malloc(sizeof (int) * d->ranks);
+    int r;
+
+    if (counts == NULL || displs == NULL) {
+        printf("Error while allocating memory to share clusters\n");
+        exit(-1);
+    }
+
+    for (r = 0; r < d->ranks; r++) {
+        int first = (int) ((long long) d->clusters * r / d->ranks);
+        int last = (int) ((long long) d->clusters * (r + 1) / d->ranks);
+        displs[r] = offsets[first];
+        counts[r] = offsets[last] - offsets[first];
+    }
+
+    MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL,
+            data, counts, displs, MPI_INT, MPI_COMM_WORLD);
+
+    free(counts);
+    free(displs);
+}
+#endif
+
+long long decomposeTour(pBaseGraph graph, int threads, int * tour) {
+    Decomposition d;
+    long long weight = 0;
+    int * order;
+    int * boundaries;
+    int first, last, round, i, k;
+
+    d.graph = graph;
+    d.size = getBaseGraphSize(graph);
+    d.threads = threads;
+    d.rank = 0;
+    d.ranks = 1;
+    d.nodes = (int*) malloc(sizeof (int) * d.size);
+    d.scratches = (pDijkstraScratch *) malloc(sizeof (pDijkstraScratch) * threads);
+
+#ifdef USE_MPI_MALLOC
+    {
+        int initialized;
+        MPI_Initialized(&initialized);
+        if (initialized) {
+            MPI_Comm_rank(MPI_COMM_WORLD, &d.rank);
+            MPI_Comm_size(MPI_COMM_WORLD, &d.ranks);
+        }
+    }
+#endif
+
+    if (d.nodes == NULL || d.scratches == NULL) {
+        printf("Error while allocating memory to decompose graph\n");
+        exit(-1);
+    }
+
+    for (i = 0; i < threads; i++) {
+        d.scratches[i] = createDijkstraScratch(graph);
+    }
+
+    /* a tour needs every node reachable from node 0, every rank finds the same */
+    for (i = 0; i < d.size; i++) {
+        d.nodes[i] = i;
+    }
+
+    targetDistances(graph, d.scratches[0], 0, d.nodes, d.size, tour);
+
+    for (i = 0; i < d.size && tour[i] != INT_MAX; i++) {
+    }
+
+    if (i < d.size) {
+        for (i = 0; i < threads; i++) {
+            destroyDijkstraScratch(d.scratches[i]);
+        }
+        free(d.scratches);
+        free(d.nodes);
+        return UNDEFINED;
+    }
+
+    /* every rank clusters the same way, so only the cluster tours are shared */
+    clusterNodes(&d);
+    d.medoids = (int*) malloc(sizeof (int) * d.clusters);
+
+    if (d.medoids == NULL) {
+        printf("Error while allocating memory to decompose graph\n");
+        exit(-1);
+    }
+
+    refineClusters(&d);
+    k = d.clusters;
+
+    d.cycle = (int*) malloc(sizeof (int) * d.size);
+    d.cycleWeights = (int*) malloc(sizeof (int) * d.size);
+    d.medoidDistances = (int*) malloc(sizeof (int) * k * k);
+
+    if (d.cycle == NULL || d.cycleWeights == NULL || d.medoidDistances == NULL) {
+        printf("Error while allocating memory to decompose graph\n");
+        exit(-1);
+    }
+
+    first = (int) ((long long) k * d.rank / d.ranks);
+    last = (int) ((long long) k * (d.rank + 1) / d.ranks);
+
+    runParallel(&d, solveCluster, first, last);
+
+#ifdef USE_MPI_MALLOC
+    if (d.ranks > 1) {
+        int * offsets = (int*) malloc(sizeof (int) * (k + 1));
+
+        if (offsets == NULL) {
+            printf("Error while allocating memory to decompose graph\n");
+            exit(-1);
+        }
+
+        shareClusters(&d, d.cycle, d.starts);
+        shareClusters(&d, d.cycleWeights, d.starts);
+
+        for (i = 0; i <= k; i++) {
+            offsets[i] = i;
+        }
+        shareClusters(&d, d.medoids, offsets);
+
+        runParallel(&d, measureMedoids, first, last);
+
+        for (i = 0; i <= k; i++) {
+            offsets[i] = i * k;
+        }
+        shareClusters(&d, d.medoidDistances, offsets);
+
+        free(offsets);
+    } else
+#endif
+    {
+        runParallel(&d, measureMedoids, 0, k);
+    }
+
+    order = (int*) malloc(sizeof (int) * (k + 1));
+    boundaries = (int*) malloc(sizeof (int) * k);
+    d.tour = (int*) malloc(sizeof (int) * (d.size + 1));
+    d.windows = (int*) malloc(sizeof (int) * k);
+    d.legs = (int*) malloc(sizeof (int) * d.size);
+
+    if (order == NULL || boundaries == NULL || d.tour == NULL || d.windows == NULL || d.legs == NULL) {
+        printf("Error while allocating memory to decompose graph\n");
+        exit(-1);
+    }
+
+    if (d.rank == 0) {
+        orderClusters(&d, order);
+        stitchClusters(&d, order, boundaries);
+
+        /* windows polished together never overlap, the joints left wait for the next round */
+        for (round = 1; round < k; round++) {
+            int count = 0;
+            int end = INT_MIN;
+            for (i = 1; i < k; i++) {
+                if (boundaries[i] != UNDEFINED && boundaries[i] - DECOMPOSE_WINDOW >= end) {
+                    d.windows[count++] = boundaries[i];
+                    end = boundaries[i] + DECOMPOSE_WINDOW;
+                    boundaries[i] = UNDEFINED;
+                }
+            }
+            if (count == 0) {
+                break;
+            }
+            runParallel(&d, polishWindow, 0, count);
+        }
+
+        runParallel(&d, measureLeg, 0, d.size);
+
+        for (i = 0; i < d.size; i++) {
+            weight += d.legs[i];
+        }
+
+        for (first = 0; d.tour[first] != 0; first++) {
+        }
+
+        for (i = 0; i < d.size; i++) {
+            tour[i] = d.tour[(first + i) % d.size];
+        }
+        tour[d.size] = tour[0];
+    } else {
+        weight = UNDEFINED;
+    }
+
+    free(d.nodes);
+    free(d.segments);
+    free(d.splits);
+    free(d.starts);
+    free(d.cycle);
+    free(d.cycleWeights);
+    free(d.medoids);
+    free(d.medoidDistances);
+    free(d.tour);
+    free(d.windows);
+    free(d.legs);
+    free(order);
+    free(boundaries);
+
+    for (i = 0; i < threads; i++) {
+        destroyDijkstraScratch(d.scratches[i]);
+    }
+    free(d.scratches);
+
+    return weight;
+}
+
+void runDecomposition(int argc, char* argv[], const char * input, const char * output, int threads) {
+    Instance instance;
+    pBaseGraph g;
+    int * tour;
+    long long weight;
+    int rank = 0;
+    int valid = TRUE;
+    int i;
+    struct timespec start, now;
+
+#ifdef USE_MPI_MALLOC
+    int provided;
+    /* only the main thread calls MPI, the workers build local solvers */
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+#endif
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (rank == 0) {
+        FILE * in = strcmp(input, "-") == 0 ? stdin : fopen(input, "r");
+
+        if (in == NULL || !readInstance(in, &instance)) {
+            printf("Error while reading instance from %s\n", input);
+            exit(-1);
+        }
+
+        if (in != stdin) {
+            fclose(in);
+        }
+    }
+
+#ifdef USE_MPI_MALLOC
+    /* only rank 0 reads, the others get the edges */
+    MPI_Bcast(instance.id, BATCH_ID_SIZE, MPI_CHAR, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&instance.size, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&instance.count, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    if (rank != 0) {
+        instance.edges = (int*) malloc(sizeof (int) * 3 * (instance.count + 1));
+        if (instance.edges == NULL) {
+            printf("Error while allocating memory to read instance\n");
+            exit(-1);
+        }
+    }
+
+    MPI_Bcast(instance.edges, 3 * instance.count, MPI_INT, 0, MPI_COMM_WORLD);
+#endif
+
+    if (instance.size < 1) {
+        printf("Error while reading instance from %s\n", input);
+        exit(-1);
+    }
+
+    g = createBaseGraph(instance.size, 1);
+
+    for (i = 0; i < instance.count; i++) {
+        int src = instance.edges[3 * i];
+        int dst = instance.edges[3 * i + 1];
+        if (instance.edges[3 * i + 2] < 0) {
+            valid = FALSE;
+        } else if (src >= 0 && dst >= 0 && src < instance.size && dst < instance.size) {
+            addBaseEdge(g, src, dst, instance.edges[3 * i + 2]);
+        }
+    }
+
+    tour = (int*) malloc(sizeof (int) * (instance.size + 1));
+
+    if (tour == NULL) {
+        printf("Error while allocating memory to decompose graph\n");
+        exit(-1);
+    }
+
+    /* every rank read the same edges, so they all skip a bad instance together */
+    weight = valid ? decomposeTour(g, threads, tour) : UNDEFINED;
+
+    if (rank == 0) {
+        FILE * out = output == NULL ? stdout : fopen(output, "w");
+
+        if (out == NULL) {
+            printf("Error while opening %s\n", output);
+            exit(-1);
+        }
+
+        if (weight < 0) {
+            fprintf(out, "%s error\n", instance.id);
+        } else {
+            fprintf(out, "%s %lld", instance.id, weight);
+            for (i = 0; i <= instance.size; i++) {
+                fprintf(out, " %d", tour[i]);
+            }
+            fprintf(out, "\n");
+        }
+
+        if (out != stdout) {
+            fclose(out);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        fprintf(stderr, "Toured %d nodes in %.3f seconds\n", instance.size,
+                (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9);
+    }
+
+    free(tour);
+    destroyBaseGraph(g);
+    destroyInstance(&instance);
+
+#ifdef USE_MPI_MALLOC
+    MPI_Finalize();
+#endif
+}
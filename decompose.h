@@ -0,0 +1,34 @@
+#ifndef GUARD_C_MPI_DECOMPOSE
+#define GUARD_C_MPI_DECOMPOSE
+
+#include "query.h"
+
+/* nodes of a cluster at most */
+#define DECOMPOSE_CLUSTER_SIZE 64
+/* clusters up to this size are solved exactly, larger ones by 2-opt */
+#define DECOMPOSE_EXACT_SIZE 9
+/* nodes on each side of a cluster boundary polished together */
+#define DECOMPOSE_WINDOW (DECOMPOSE_CLUSTER_SIZE / 4)
+
+/*
+ * Graphs far too large for the exhaustive search are split by recursive
+ * bisection on their shortest distances into clusters, refined by a few
+ * k-medoids rounds. The clusters are solved in parallel, exactly when they
+ * are small enough and else by 2-opt from a nearest neighbor tour. Their
+ * medoids are ordered as a smaller tour,
+ * each cluster tour is opened where it best joins the previous one, and
+ * 2-opt is run over windows across the joints.
+ *
+ * With MPI the clusters and the distances between medoids are split across
+ * the ranks, every rank running threads over its share.
+ */
+
+// return the weight of a tour over every node of graph, tour receives size + 1 nodes from node 0
+// (-1 when the graph is not connected and on the ranks other than 0, which only help)
+long long decomposeTour(pBaseGraph graph, int threads, int * tour);
+
+// find a tour over the graph of the first instance of input ("-" for stdin),
+// writing "<id> <weight> <node> ... <node>" to output (NULL for stdout), "<id> error" when there is none
+void runDecomposition(int argc, char* argv[], const char * input, const char * output, int threads);
+
+#endif
@@ -1,4 +1,11 @@
 #include "graph.h"
+#include "checkpoint.h"
+#include "unrank.h"
+#include "localsearch.h"
+#include "presolve.h"
+#include "anytime.h"
+#include "cache.h"
+#include "construct.h"
 
 #define GRAPH_PRINT_STEP
 //#define USE_MPI_MALLOC
@@ -14,11 +21,11 @@
 #include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 
 typedef struct {
     char id;
-    int step; // dijkstra
 } Node, *pNode;
 
 typedef struct StructLinkedNode {
@@ -35,37 +42,96 @@ typedef struct {
     int * edges;
     pNode * nodes;
     int size;
+    /* from MPI_Alloc_mem in the MPI build */
+    int shared;
 } Graph, *pGraph;
 
-static unsigned long timestamp;
-static pGraph graph = NULL;
-static pPath * artificialEdges = NULL;
-static int * factorialHashTable = NULL;
-
+struct StructSolver {
+    pGraph graph;
+    /* shortest distance between every pair of nodes, row per source */
+    int * closure;
+    /* previous[src * size + v] is the node visited before v coming from src */
+    int * previous;
+    /* edges of the graph, missing ones replaced by the closure */
+    int * weights;
+    /* dijkstra and path expansion scratch */
+    int * stepped;
+    int * scratch;
+    Unranker unranker;
+    unsigned long timestamp;
+    /* nodes the buffers above were allocated for */
+    int capacity;
+    /* buffers from MPI_Alloc_mem in the MPI build, plain malloc otherwise */
+    int shared;
+    int closed;
+    /* NULL when the search writes no checkpoints */
+    pCheckpoint checkpoint;
+    int verbose;
+    int presolve;
+    /* solver of the presolved graph, kept to be reused */
+    pSolver reduced;
+    /* seconds a solve may take, 0 to search every tour */
+    double budget;
+    /* the budgeted search under way, NULL otherwise */
+    pAnytime anytime;
+    /* store looked up before and filled after every solve, NULL for none */
+    pResultCache cache;
+    /* walk of the best tour when it came from the cache or a presolve, NULL otherwise */
+    int * walk;
+    int walkLength;
+    int lower;
+    /* proven lower bound on the weight of any tour, lower once it is optimal */
+    int bound;
+    long long key;
+};
+
+static void * allocateMemory(int shared, size_t bytes);
+static void releaseMemory(int shared, void * memory);
+static pSolver newSolver(int size, int shared);
+static pGraph createGraph(int size, int shared);
+static void destroyGraph(pGraph graph);
 static void destroyPath(pPath path);
 static void printPath(pPath path);
-static void printRealPath(pPath p);
-static void destroyArtificialEdges(void);
-static void createArtificialEdges(void);
-static void initDijkstra(int * pathSizes, int * previous);
-static int allStepped(void);
-static int lowerPath(int * paths);
-static pPathNode addPathNode(int u, pPathNode lastPathNode);
-static pPath dijkstra(int src, int dst);
-static int getWeightFromIndex(int start, int idx);
-static pPath getPathFromIndex(int start, int idx);
-static unsigned int factorial(unsigned int n);
-static int getWeightFromNodes(pNode src, pNode dst);
-static void getLowerPath(int startNode, int start, int end, int * lower, int * lowerKey);
-static void parallelSolution(int argc, char* argv[]);
+static void printRealPath(pSolver s, pPath p);
+static void destroyArtificialEdges(pSolver s);
+static void createArtificialEdges(pSolver s);
+static void initDijkstra(pSolver s, int * pathSizes, int * previous);
+static int allStepped(pSolver s);
+static int lowerPath(pSolver s, int * paths);
+static void dijkstra(pSolver s, int src);
+static int getWeightFromIndex(pSolver s, int start, long long idx);
+static pPath getPathFromIndex(pSolver s, int start, long long idx);
+static long long countTours(pSolver s);
+static int getWeightFromNodes(pSolver s, pNode src, pNode dst);
+static void getLowerPath(pSolver s, int startNode, long long start, long long end, int * lower,
+        long long * lowerKey);
+static unsigned long hashGraph(pSolver s);
+static void searchRange(pSolver s, int startNode, long long start, long long end, int rank,
+        int size, int * lower, long long * lowerKey);
+static void getLowerPathBounded(pSolver s, long long start, long long end, int bound,
+        int * lower, long long * lowerKey);
+static void fillWeights(pSolver s);
+static void allocateArtificialEdges(pSolver s);
+#ifdef USE_MPI_MALLOC
+static void createArtificialEdgesParallel(pSolver s, int rank, int size);
+#endif
+static void lowerEdge(pSolver s, int u, int v, int weight);
+static int presolveSolution(pSolver s);
+static void mapPresolvedTour(pSolver s, pPresolve p, pSolver reduced);
+static int getSolverWalk(pSolver s, int ** walk);
+static void searchWithin(pSolver s);
+static int cachedSolution(pSolver s);
+static void cacheSolution(pSolver s);
+static void forgetWalk(pSolver s);
+static int connectedGraph(pSolver s);
 
 #ifdef USE_MPI_MALLOC
-static int taskDivision(int size, int qtt);
+static long long taskDivision(int size, long long qtt);
 
-int taskDivision(int size, int qtt) {
+long long taskDivision(int size, long long qtt) {
     int i;
-    int buffLimit = qtt;
-    int divMaster = 0;
+    long long buffLimit = qtt;
+    long long divMaster = 0;
 
     if (size > 0) {
 
@@ -73,12 +139,12 @@ int taskDivision(int size, int qtt) {
         buffLimit -= divMaster;
 
         for (i = 1; i < size; i++) {
-            int div = qtt / size;
+            long long div = qtt / size;
             buffLimit -= div;
             if (buffLimit != 0 && i == (size - 1)) {
                 div += buffLimit;
             }
-            MPI_Send(&div, 1, MPI_INT, i, 0, MPI_COMM_WORLD);
+            MPI_Send(&div, 1, MPI_LONG_LONG, i, 0, MPI_COMM_WORLD);
         }
 
     }
@@ -87,115 +153,149 @@ int taskDivision(int size, int qtt) {
 }
 #endif
 
-void getLowerPath(int startNode, int start, int end, int * lower, int * lowerKey) {
-    int i;
+void getLowerPath(pSolver s, int startNode, long long start, long long end, int * lower,
+        long long * lowerKey) {
+    long long i;
     *lower = INT_MAX;
     *lowerKey = -1;
 
 #ifdef GRAPH_PRINT_STEP
-    printf("searching from %d to %d\n", start, end);
+    if (s->verbose) {
+        printf("searching from %lld to %lld\n", start, end);
+    }
 #endif
 
     for (i = start; i <= end; i++) {
-        int w = getWeightFromIndex(startNode, i);
+        int w = getWeightFromIndex(s, startNode, i);
         if (w < *lower) {
             *lower = w;
             *lowerKey = i;
         }
+        if (s->checkpoint && ((i - start) & CHECKPOINT_MASK) == CHECKPOINT_MASK) {
+            updateCheckpoint(s->checkpoint, i, *lower, *lowerKey);
+        }
     }
 
 #ifdef GRAPH_PRINT_STEP
-    printf("finished searching from %d to %d\n", start, end);
+    if (s->verbose) {
+        printf("finished searching from %lld to %lld\n", start, end);
+    }
 #endif
 }
 
-static void sequentialSolution(void);
-static unsigned long finishTimestamp(void);
-static void startTimestamp(void);
+unsigned long hashGraph(pSolver s) {
+    /* FNV-1a over the weight matrix, identifies the instance in checkpoints */
+    unsigned long hash = 14695981039346656037UL;
+    int i;
 
-void sequentialSolution(void) {
-    if (graph != NULL) {
+    hash = (hash ^ (unsigned long) s->graph->size) * 1099511628211UL;
+
+    for (i = 0; i < s->graph->size * s->graph->size; i++) {
+        hash = (hash ^ (unsigned long) (unsigned int) s->weights[i]) * 1099511628211UL;
+    }
 
-        startTimestamp();
-        createArtificialEdges();
+    return hash;
+}
 
-        {
-            int fact = factorialHashTable[graph->size - 1] / 2 - 1;
-            int lower;
-            int key;
-            pPath p;
+void searchRange(pSolver s, int startNode, long long start, long long end, int rank,
+        int size, int * lower, long long * lowerKey) {
+    if (s->checkpoint == NULL) {
+        getLowerPath(s, startNode, start, end, lower, lowerKey);
+    } else {
+        unsigned long hash = hashGraph(s);
+        pWorkUnit units;
+        int count;
+        int i;
 
-            printf("Start sequential run:\n");
-            getLowerPath(0, 0, fact, &lower, &key);
+        count = loadCheckpointUnits(s->checkpoint, hash, rank, size, start, end, &units, lower, lowerKey);
+        startCheckpoint(s->checkpoint, hash, rank, size, units, count, *lower, *lowerKey);
 
-            p = getPathFromIndex(0, key);
+        for (i = 0; i < count; i++) {
+            int l;
+            long long k;
 
-            printPath(p);
-            printRealPath(p);
+            beginCheckpointUnit(s->checkpoint, i);
+            getLowerPath(s, startNode, units[i].cursor + 1, units[i].end, &l, &k);
+            updateCheckpoint(s->checkpoint, units[i].end, l, k);
 
-            destroyPath(p);
+            if (l < *lower) {
+                *lower = l;
+                *lowerKey = k;
+            }
         }
 
-        destroyArtificialEdges();
-        finishTimestamp();
+        finishCheckpoint(s->checkpoint);
+        free(units);
+    }
+}
+
+static void sequentialSolution(pSolver s);
+static unsigned long finishTimestamp(pSolver s);
+static void startTimestamp(pSolver s);
+
+void sequentialSolution(pSolver s) {
+    if (s != NULL) {
+
+        startTimestamp(s);
+
+        printf("Start sequential run:\n");
+        solve(s);
+        printSolverTour(s);
+
+        finishTimestamp(s);
 
     }
 }
 
-void startTimestamp(void) {
+void startTimestamp(pSolver s) {
     struct timespec spec;
-    time_t s;
+    time_t t;
     unsigned long time_in_micros;
     clock_gettime(CLOCK_REALTIME, &spec);
-    s = spec.tv_sec;
+    t = spec.tv_sec;
     time_in_micros = spec.tv_sec;
-    timestamp = time_in_micros;
+    s->timestamp = time_in_micros;
 }
 
-unsigned long finishTimestamp(void) {
+unsigned long finishTimestamp(pSolver s) {
     struct timespec spec;
-    time_t s;
+    time_t t;
     unsigned long time_in_micros;
     unsigned long ret;
     clock_gettime(CLOCK_REALTIME, &spec);
-    s = spec.tv_sec;
+    t = spec.tv_sec;
     time_in_micros = spec.tv_sec;
-    ret = time_in_micros - timestamp;
-    timestamp = ret;
-    printf("Total time (seconds): %lu\n", timestamp);
+    ret = time_in_micros - s->timestamp;
+    s->timestamp = ret;
+    printf("Total time (seconds): %lu\n", s->timestamp);
     return ret;
 }
 
-unsigned int factorial(unsigned int n) {
-    int i = 2;
-    int ret = 1;
-    for (; i <= n; i++) {
-        ret *= i;
+long long countTours(pSolver s) {
+    long long count = countCanonicalTours(&s->unranker);
+
+    if (count < 0) {
+        printf("Graph too large to enumerate its tours\n");
+        exit(-1);
     }
-    return ret;
+
+    return count;
 }
 
-pPath getPathFromIndex(int start, int idx) {
+pPath getPathFromIndex(pSolver s, int start, long long idx) {
     pPath ret;
-    pNode * others;
-
+    int order[UNRANK_MAX_NODES + 1];
     pPathNode pathNode;
-    pPathNode lastPathNode = pathNode;
-    int countNotUsed = graph->size - 1;
-    int i, j;
-    pNode startNode = graph->nodes[start];
-    pNode src;
-    pNode dst;
+    pPathNode lastPathNode = NULL;
+    int i;
 
 #ifndef USE_MPI_MALLOC
     ret = (pPath) malloc(sizeof (Path));
-    others = (pNode*) malloc(sizeof (pNode) * (graph->size - 1));
 #else
     MPI_Alloc_mem(sizeof (Path), MPI_INFO_NULL, &ret);
-    MPI_Alloc_mem(sizeof (pNode) * (graph->size - 1), MPI_INFO_NULL, &others);
 #endif
 
-    if (others == NULL || ret == NULL) {
+    if (ret == NULL) {
         printf("ERROR WHILE ALLOCATING MEMORY TO GET WEIGHT FROM INDEX\n");
         exit(-1);
     }
@@ -203,49 +303,9 @@ pPath getPathFromIndex(int start, int idx) {
     ret->first = NULL;
     ret->totalWeight = 0;
 
-    for (j = 0, i = 0; i < graph->size; i++) {
-        if (i != start) {
-            others[j++] = graph->nodes[i];
-        }
-    }
-
-    src = startNode;
-
-#ifndef USE_MPI_MALLOC
-    pathNode = (pPathNode) malloc(sizeof (PathNode));
-#else
-    MPI_Alloc_mem(sizeof (PathNode), MPI_INFO_NULL, &pathNode);
-#endif
-
-    if (pathNode == NULL) {
-        printf("Error while allocating memory to create path\n");
-        exit(-1);
-    }
-
-    pathNode->node = src;
-    ret->first = pathNode;
-
-    while (countNotUsed-- > 0) {
-        lastPathNode = pathNode;
-        int size = (graph->size - (graph->size - countNotUsed));
-        int fact = factorialHashTable[size];
-        int dstCount = 0;
-        pNode selected = NULL;
-        int dstN = idx / fact;
-        idx %= fact;
-        for (i = 0; i < (graph->size - 1) && selected == NULL; i++) {
-            if (others[i] != NULL) {
-                if (dstCount++ == dstN) {
-                    selected = others[i];
-                    others[i] = NULL;
-                }
-            }
-        }
+    unrankCanonical(&s->unranker, start, idx, order);
 
-        dst = selected;
-
-        ret->totalWeight += getWeightFromNodes(src, dst);
-        src = dst;
+    for (i = 0; i <= s->graph->size; i++) {
 
 #ifndef USE_MPI_MALLOC
         pathNode = (pPathNode) malloc(sizeof (PathNode));
@@ -258,135 +318,93 @@ pPath getPathFromIndex(int start, int idx) {
             exit(-1);
         }
 
-        pathNode->node = src;
-        lastPathNode->next = pathNode;
-    }
-
-    lastPathNode = pathNode;
-    dst = startNode;
-    ret->totalWeight += getWeightFromNodes(src, dst);
+        pathNode->node = s->graph->nodes[order[i]];
+        pathNode->next = NULL;
 
-#ifndef USE_MPI_MALLOC
-    pathNode = (pPathNode) malloc(sizeof (PathNode));
-#else
-    MPI_Alloc_mem(sizeof (PathNode), MPI_INFO_NULL, &pathNode);
-#endif
+        if (lastPathNode == NULL) {
+            ret->first = pathNode;
+        } else {
+            lastPathNode->next = pathNode;
+            ret->totalWeight += getWeightFromNodes(s, lastPathNode->node, pathNode->node);
+        }
 
-    if (pathNode == NULL) {
-        printf("Error while allocating memory to create path\n");
-        exit(-1);
+        lastPathNode = pathNode;
     }
 
-    pathNode->node = dst;
-    pathNode->next = NULL;
-    lastPathNode->next = pathNode;
-
-#ifndef USE_MPI_MALLOC
-    free(others);
-#else
-    MPI_Free_mem(others);
-#endif
-
     return ret;
 }
 
-int getWeightFromNodes(pNode src, pNode dst) {
-    return graph->edges[(src->id - 'A') * graph->size + (dst->id - 'A')];
+int getWeightFromNodes(pSolver s, pNode src, pNode dst) {
+    return s->weights[(src->id - 'A') * s->graph->size + (dst->id - 'A')];
 }
 
-int getWeightFromIndex(int start, int idx) {
+int getWeightFromIndex(pSolver s, int start, long long idx) {
 
-    pNode * others;
+    int order[UNRANK_MAX_NODES + 1];
     int ret = 0;
-    int countNotUsed = graph->size - 1;
-    int i, j;
-    pNode startNode = graph->nodes[start];
-    pNode src;
-    pNode dst;
+    int size = s->graph->size;
+    int i;
 
-#ifndef USE_MPI_MALLOC
-    others = (pNode*) malloc(sizeof (pNode) * (graph->size - 1));
-#else
-    MPI_Alloc_mem(sizeof (pNode) * (graph->size - 1), MPI_INFO_NULL, &others);
-#endif
+    unrankCanonical(&s->unranker, start, idx, order);
 
-    if (others == NULL) {
-        printf("ERROR WHILE ALLOCATING MEMORY TO GET WEIGHT FROM INDEX\n");
-        exit(-1);
+    for (i = 0; i < size; i++) {
+        ret += s->weights[order[i] * size + order[i + 1]];
     }
 
-    for (j = 0, i = 0; i < graph->size; i++) {
-        if (i != start) {
-            others[j++] = graph->nodes[i];
+#ifdef GRAPH_PRINT_STEP
+    if (s->verbose) {
+        printf("%lld - ", idx);
+        for (i = 0; i <= size; i++) {
+            printf("%c", s->graph->nodes[order[i]]->id);
         }
+        printf(" - %d\n", ret);
     }
+#endif
 
-    src = startNode;
+    return ret;
+}
 
-#ifdef GRAPH_PRINT_STEP
-    printf("%d - %c", idx, src->id);
-#endif
+void * allocateMemory(int shared, size_t bytes) {
+#ifdef USE_MPI_MALLOC
+    if (shared) {
+        void * memory;
 
-    while (countNotUsed-- > 0) {
-        int size = (graph->size - (graph->size - countNotUsed));
-        int fact = factorialHashTable[size];
-        int dstCount = 0;
-        pNode selected = NULL;
-        int dstN = idx / fact;
-        idx %= fact;
-        for (i = 0; i < (graph->size - 1) && selected == NULL; i++) {
-            if (others[i] != NULL) {
-                if (dstCount++ == dstN) {
-                    selected = others[i];
-                    others[i] = NULL;
-                }
-            }
+        if (MPI_Alloc_mem((MPI_Aint) bytes, MPI_INFO_NULL, &memory) != MPI_SUCCESS) {
+            return NULL;
         }
 
-        dst = selected;
-#ifdef GRAPH_PRINT_STEP
-        printf("%c", dst->id);
-#endif
-        ret += getWeightFromNodes(src, dst);
-        src = dst;
+        return memory;
     }
-
-    dst = startNode;
-    ret += getWeightFromNodes(src, dst);
-
-#ifdef GRAPH_PRINT_STEP
-    printf("%c - %d\n", dst->id, ret);
+#else
+    (void) shared;
 #endif
+    return malloc(bytes);
+}
 
-#ifndef USE_MPI_MALLOC
-    free(others);
+void releaseMemory(int shared, void * memory) {
+#ifdef USE_MPI_MALLOC
+    if (shared) {
+        MPI_Free_mem(memory);
+        return;
+    }
 #else
-    MPI_Free_mem(others);
+    (void) shared;
 #endif
-
-    return ret;
+    free(memory);
 }
 
-void createGraph(int size) {
+pGraph createGraph(int size, int shared) {
 
-    if (graph != NULL) {
-        destroyGraph();
-    }
+    pGraph graph;
 
-#ifndef USE_MPI_MALLOC
-    graph = (pGraph) malloc(sizeof (Graph));
-#else
-    MPI_Alloc_mem(sizeof (Graph), MPI_INFO_NULL, &graph);
-#endif
+    graph = (pGraph) allocateMemory(shared, sizeof (Graph));
 
     if (graph != NULL) {
         int i;
 
-#ifndef USE_MPI_MALLOC
-        graph->nodes = (pNode*) malloc(sizeof (pNode) * size);
-#else
-        MPI_Alloc_mem(sizeof (pNode) * size, MPI_INFO_NULL, &graph->nodes);
-#endif
+        graph->shared = shared;
+
+        graph->nodes = (pNode*) allocateMemory(graph->shared, sizeof (pNode) * size);
 
         graph->size = size;
 
@@ -394,58 +412,31 @@ void createGraph(int size) {
             int err = FALSE;
 
             for (i = 0; i < size && !err; i++) {
-#ifndef USE_MPI_MALLOC
-                graph->nodes[i] = (pNode) malloc(sizeof (Node));
-#else
-                MPI_Alloc_mem(sizeof (Node), MPI_INFO_NULL, &graph->nodes[i]);
-#endif
+                graph->nodes[i] = (pNode) allocateMemory(graph->shared, sizeof (Node));
 
 
                 if (graph->nodes[i] == NULL) {
                     err = TRUE;
                 } else {
                     graph->nodes[i]->id = 'A' + i;
-                    graph->nodes[i]->step = FALSE;
                 }
             }
 
             if (!err) {
 
-#ifndef USE_MPI_MALLOC
-                graph->edges = (int*) malloc(sizeof (int) * size * size);
-#else
-                MPI_Alloc_mem(sizeof (int) * size * size, MPI_INFO_NULL, &graph->edges);
-#endif
+                graph->edges = (int*) allocateMemory(graph->shared, sizeof (int) * size * size);
 
                 if (graph->edges == NULL) {
 
-#ifndef USE_MPI_MALLOC
-                    free(graph->nodes);
-                    free(graph);
-
-#else
-                    MPI_Free_mem(graph->nodes);
-                    MPI_Free_mem(graph);
-#endif
+                    releaseMemory(graph->shared, graph->nodes);
+                    releaseMemory(graph->shared, graph);
 
-                    graph = NULL;
                     printf("Error while allocating memory to create graph\n");
                     exit(-1);
                 } else {
 
-#ifndef USE_MPI_MALLOC
-                    factorialHashTable = (int*) malloc(sizeof (int) * size);
-#else
-                    MPI_Alloc_mem(sizeof (int) * size, MPI_INFO_NULL, &factorialHashTable);
-#endif
-
-                    if (factorialHashTable == NULL) {
-                        printf("Error while allocating memory to create factorial hash table\n");
-                        exit(-1);
-                    }
-
-                    for (i = 0; i < size; i++) {
-                        factorialHashTable[i] = factorial(i);
+                    for (i = 0; i < size * size; i++) {
+                        graph->edges[i] = 0;
                     }
                 }
 
@@ -454,284 +445,890 @@ void createGraph(int size) {
                 int j;
 
                 for (j = 0; j < i; j++) {
-#ifndef USE_MPI_MALLOC
-                    free(graph->nodes[j]);
-#else
-                    MPI_Free_mem(graph->nodes[j]);
-#endif
+                    releaseMemory(graph->shared, graph->nodes[j]);
                 }
 
-#ifndef USE_MPI_MALLOC
-                free(graph->nodes);
-                free(graph);
-#else
-                MPI_Free_mem(graph->nodes);
-                MPI_Free_mem(graph);
-#endif
+                releaseMemory(graph->shared, graph->nodes);
+                releaseMemory(graph->shared, graph);
 
-                graph = NULL;
                 printf("Error while allocating memory to create graph\n");
                 exit(-1);
 
             }
 
         } else {
-#ifndef USE_MPI_MALLOC
-            free(graph);
-#else
-            MPI_Free_mem(graph);
-#endif
-            graph = NULL;
+            releaseMemory(graph->shared, graph);
             printf("Error while allocating memory to create graph\n");
             exit(-1);
         }
 
+    } else {
+        printf("Error while allocating memory to create graph\n");
+        exit(-1);
     }
 
+    return graph;
 }
 
-void destroyGraph(void) {
+void destroyGraph(pGraph graph) {
 
     if (graph != NULL) {
 
         int i = 0;
 
-#ifndef USE_MPI_MALLOC
-        free(graph->edges);
-#else
-        MPI_Free_mem(graph->edges);
-#endif
+        releaseMemory(graph->shared, graph->edges);
 
         for (; i < graph->size; i++) {
-#ifndef USE_MPI_MALLOC
-            free(graph->nodes[i]);
-#else
-            MPI_Free_mem(graph->nodes[i]);
-#endif
+            releaseMemory(graph->shared, graph->nodes[i]);
         }
 
-#ifndef USE_MPI_MALLOC
-        free(graph->nodes);
-        free(graph);
-        free(factorialHashTable);
-#else
-        MPI_Free_mem(graph->nodes);
-        MPI_Free_mem(graph);
-        MPI_Free_mem(factorialHashTable);
-#endif
+        releaseMemory(graph->shared, graph->nodes);
+        releaseMemory(graph->shared, graph);
 
     }
+}
+
+pSolver createSolver(int size) {
+    return newSolver(size, TRUE);
+}
 
-    factorialHashTable = NULL;
-    graph = NULL;
+pSolver createLocalSolver(int size) {
+    return newSolver(size, FALSE);
 }
 
-void initDijkstra(int * pathSizes, int * previous) {
+pSolver newSolver(int size, int shared) {
+    pSolver s;
+
+    s = (pSolver) allocateMemory(shared, sizeof (Solver));
+
+    if (s == NULL) {
+        printf("Error while allocating memory to create solver\n");
+        exit(-1);
+    }
+
+    s->shared = shared;
+    s->graph = createGraph(size, shared);
+    s->closure = NULL;
+    s->previous = NULL;
+    s->weights = NULL;
+    s->timestamp = 0;
+    s->capacity = size;
+    s->closed = FALSE;
+    s->checkpoint = NULL;
+    s->verbose = FALSE;
+    s->presolve = TRUE;
+    s->reduced = NULL;
+    s->budget = 0;
+    s->anytime = NULL;
+    s->cache = NULL;
+    s->walk = NULL;
+    s->walkLength = 0;
+    s->lower = INT_MAX;
+    s->bound = 0;
+    s->key = UNDEFINED;
+
+    s->stepped = (int*) allocateMemory(s->shared, sizeof (int) * size);
+    s->scratch = (int*) allocateMemory(s->shared, sizeof (int) * size);
+
+    if (s->stepped == NULL || s->scratch == NULL) {
+        printf("Error while allocating memory to create solver\n");
+        exit(-1);
+    }
+
+    initUnranker(&s->unranker, size);
+
+    return s;
+}
+
+void destroySolver(pSolver s) {
+    if (s != NULL) {
+        destroySolver(s->reduced);
+        destroyCheckpoint(s->checkpoint);
+        forgetWalk(s);
+        destroyArtificialEdges(s);
+        destroyGraph(s->graph);
+
+        releaseMemory(s->shared, s->stepped);
+        releaseMemory(s->shared, s->scratch);
+        releaseMemory(s->shared, s);
+    }
+}
+
+void resetSolver(pSolver s, int size) {
     int i;
-    for (i = 0; i < graph->size; i++) {
-        graph->nodes[i]->step = FALSE;
-        pathSizes[i] = INT_MAX;
-        previous[i] = UNDEFINED;
+
+    if (size > s->capacity) {
+        destroyArtificialEdges(s);
+        destroyGraph(s->graph);
+
+        releaseMemory(s->shared, s->stepped);
+        releaseMemory(s->shared, s->scratch);
+        s->stepped = (int*) allocateMemory(s->shared, sizeof (int) * size);
+        s->scratch = (int*) allocateMemory(s->shared, sizeof (int) * size);
+
+        if (s->stepped == NULL || s->scratch == NULL) {
+            printf("Error while allocating memory to reset solver\n");
+            exit(-1);
+        }
+
+        s->graph = createGraph(size, s->shared);
+        s->capacity = size;
+    } else {
+        /* nodes past size stay allocated for the next bigger instance */
+        s->graph->size = size;
+        for (i = 0; i < size * size; i++) {
+            s->graph->edges[i] = 0;
+        }
     }
+
+    initUnranker(&s->unranker, size);
+    forgetWalk(s);
+    s->closed = FALSE;
+    s->lower = INT_MAX;
+    s->bound = 0;
+    s->key = UNDEFINED;
 }
 
-int allStepped(void) {
-    int i = 0;
-    for (; i < graph->size; i++) {
-        if (!graph->nodes[i]->step) {
-            return FALSE;
+void setSolverVerbose(pSolver s, int verbose) {
+    s->verbose = verbose;
+}
+
+void setSolverPresolve(pSolver s, int presolve) {
+    s->presolve = presolve;
+}
+
+void setSolverBudget(pSolver s, double seconds) {
+    s->budget = seconds;
+}
+
+void setSolverCache(pSolver s, pResultCache cache) {
+    s->cache = cache;
+}
+
+void setSolverCheckpoint(pSolver s, const char * dir, int restart, int interval) {
+    destroyCheckpoint(s->checkpoint);
+    s->checkpoint = dir != NULL ? createCheckpoint(dir, restart, interval) : NULL;
+}
+
+void addSolverEdge(pSolver s, int src, int dst, int weight) {
+    int size = s->graph->size;
+    s->graph->edges[src * size + dst] = s->graph->edges[dst * size + src] = weight;
+    /* the closure no longer matches the graph */
+    s->closed = FALSE;
+    s->key = UNDEFINED;
+    forgetWalk(s);
+}
+
+int solve(pSolver s) {
+    forgetWalk(s);
+
+    /* no tour visits every node, and the closure would sum INT_MAX weights */
+    if (!connectedGraph(s)) {
+        s->lower = INT_MAX;
+        s->bound = 0;
+        s->key = UNDEFINED;
+        return s->lower;
+    }
+
+    /* a hit needs neither the closure nor a search */
+    if (s->cache != NULL && cachedSolution(s)) {
+        return s->lower;
+    }
+
+    if (!(s->presolve && presolveSolution(s))) {
+        createArtificialEdges(s);
+
+        if (s->budget > 0 && s->graph->size > 2) {
+            searchWithin(s);
+        } else {
+            searchRange(s, 0, 0, countTours(s) - 1, 0, 1, &s->lower, &s->key);
+            s->bound = s->lower;
         }
     }
+
+    if (s->cache != NULL) {
+        cacheSolution(s);
+    }
+
+    return s->lower;
+}
+
+/* return true when the cache knew the instance, its tour becoming the best one */
+int cachedSolution(pSolver s) {
+    int order[UNRANK_MAX_NODES + 1];
+    int weight;
+
+    if (s->graph->size > UNRANK_MAX_NODES) {
+        return FALSE;
+    }
+
+    weight = lookupResult(s->cache, s->graph->edges, s->graph->size, order, &s->walk, &s->walkLength);
+
+    if (weight == UNDEFINED) {
+        return FALSE;
+    }
+
+    s->lower = s->bound = weight;
+    s->key = rankCanonical(&s->unranker, order);
     return TRUE;
 }
 
-int lowerPath(int * paths) {
-    int i;
-    int lower = INT_MAX;
-    int lowerKey = -1;
-    for (i = 0; i < graph->size; i++) {
-        if (paths[i] <= lower && !graph->nodes[i]->step) {
-            lowerKey = i;
-            lower = paths[i];
+/* only tours proven optimal are kept, a budgeted guess would shadow the optimum */
+void cacheSolution(pSolver s) {
+    int order[UNRANK_MAX_NODES + 1];
+    int * walk;
+    int length;
+
+    if (s->key == UNDEFINED || s->lower == INT_MAX || s->bound != s->lower) {
+        return;
+    }
+
+    unrankCanonical(&s->unranker, 0, s->key, order);
+
+    /* a presolved solve kept its walk, any other one built the closure */
+    if (s->walk != NULL) {
+        storeResult(s->cache, s->graph->edges, s->graph->size, order, s->lower, s->walk, s->walkLength);
+        return;
+    }
+
+    length = getSolverWalk(s, &walk);
+    storeResult(s->cache, s->graph->edges, s->graph->size, order, s->lower, walk, length);
+    releaseMemory(s->shared, walk);
+}
+
+void forgetWalk(pSolver s) {
+    free(s->walk);
+    s->walk = NULL;
+    s->walkLength = 0;
+}
+
+/*
+ * The greedy edge tour polished by 2-opt is there at once, and the weight of
+ * the spanning tree it was built from is the first lower bound. The exact
+ * search then prunes against it and whatever the local search finds, until
+ * the budget runs out or the lower bound meets the best tour.
+ */
+void searchWithin(pSolver s) {
+    int order[UNRANK_MAX_NODES + 1];
+    int size = s->graph->size;
+    int lower;
+    long long key, tree;
+
+    if (constructTour(s->weights, size, CONSTRUCT_GREEDY_EDGE, 1, order, &tree) < 0) {
+        nearestNeighbor(s->weights, size, order);
+        tree = 0;
+    }
+
+    s->anytime = startAnytime(s->weights, size, order, twoOpt(s->weights, size, order),
+            (int) tree, s->budget);
+
+    getLowerPathBounded(s, 0, countTours(s) - 1, getAnytimeUpper(s->anytime), &lower, &key);
+
+    s->lower = stopAnytime(s->anytime, order, &s->bound);
+    s->key = rankCanonical(&s->unranker, order);
+    s->anytime = NULL;
+}
+
+/*
+ * The search runs over the presolved graph and its tour is mapped back, so
+ * the key of the solver always indexes a tour of its own graph. Return false
+ * when nothing could be reduced.
+ */
+int presolveSolution(pSolver s) {
+    pPresolve p;
+    pSolver reduced;
+    const int * edges;
+    int size, i, j;
+
+    if (s->graph->size > UNRANK_MAX_NODES) {
+        return FALSE;
+    }
+
+    p = createPresolve(s->graph->edges, s->graph->size);
+    size = getPresolveSize(p);
+
+    if (size == s->graph->size) {
+        destroyPresolve(p);
+        return FALSE;
+    }
+
+    if (s->reduced == NULL) {
+        s->reduced = newSolver(size, s->shared);
+    } else {
+        resetSolver(s->reduced, size);
+    }
+
+    reduced = s->reduced;
+    reduced->presolve = FALSE;
+    reduced->verbose = s->verbose;
+    /* borrowed for the solve only, s keeps owning it */
+    reduced->checkpoint = s->checkpoint;
+    reduced->budget = s->budget;
+
+    edges = getPresolveEdges(p);
+
+    for (i = 0; i < size; i++) {
+        for (j = i + 1; j < size; j++) {
+            if (edges[i * size + j] != 0) {
+                addSolverEdge(reduced, i, j, edges[i * size + j]);
+            }
         }
     }
-    return lowerKey;
+
+    solve(reduced);
+    reduced->checkpoint = NULL;
+    mapPresolvedTour(s, p, reduced);
+    s->bound = reduced->bound + getPresolveOffset(p);
+
+    destroyPresolve(p);
+    return TRUE;
 }
 
-pPathNode addPathNode(int u, pPathNode lastPathNode) {
-    pPathNode pathNode;
+/* the real walk of the reduced tour is expanded and its first visits give the tour */
+void mapPresolvedTour(pSolver s, pPresolve p, pSolver reduced) {
+    int order[UNRANK_MAX_NODES + 1];
+    int * walk;
+    int * expanded;
+    int length, start, i, count;
 
-#ifndef USE_MPI_MALLOC
-    pathNode = (pPathNode) malloc(sizeof (PathNode));
-#else
-    MPI_Alloc_mem(sizeof (PathNode), MPI_INFO_NULL, &pathNode);
-#endif
+    s->lower = INT_MAX;
+    s->key = UNDEFINED;
+
+    if (reduced->key == UNDEFINED || reduced->lower == INT_MAX) {
+        return;
+    }
 
-    if (pathNode == NULL) {
-        printf("Error while allocating memory for dijkstra\n");
+    length = getSolverWalk(reduced, &walk);
+    length = expandPresolveWalk(p, walk, length, &expanded);
+
+    for (start = 0; expanded[start] != 0; start++) {
+    }
+
+    for (i = 0; i < s->graph->size; i++) {
+        s->stepped[i] = FALSE;
+    }
+
+    /* the walk is closed, its last node repeats the first */
+    for (i = 0, count = 0; i < length - 1; i++) {
+        int node = expanded[(start + i) % (length - 1)];
+        if (!s->stepped[node]) {
+            s->stepped[node] = TRUE;
+            order[count++] = node;
+        }
+    }
+
+    order[count] = 0;
+
+    s->key = rankCanonical(&s->unranker, order);
+    s->lower = reduced->lower + getPresolveOffset(p);
+
+    /* kept from node 0 on, it saves the closure of the whole graph */
+    s->walk = (int*) malloc(sizeof (int) * length);
+
+    if (s->walk == NULL) {
+        printf("Error while allocating memory to expand tour\n");
         exit(-1);
     }
 
-    pathNode->node = graph->nodes[u];
-    pathNode->next = lastPathNode;
+    for (i = 0; i < length - 1; i++) {
+        s->walk[i] = expanded[(start + i) % (length - 1)];
+    }
+
+    s->walk[length - 1] = 0;
+    s->walkLength = length;
 
-    return pathNode;
+    releaseMemory(reduced->shared, walk);
+    free(expanded);
 }
 
-pPath dijkstra(int src, int dst) {
+/* return the length of the closed walk of the best tour over the graph edges, *walk to free */
+int getSolverWalk(pSolver s, int ** walk) {
+    int order[UNRANK_MAX_NODES + 1];
+    int size = s->graph->size;
+    int length = 0;
+    int * ret;
+    int i;
 
-    pPath ret = NULL;
-    int v;
-    int u;
-    int found = FALSE;
-    pPathNode lastPathNode = NULL;
+    ret = (int*) allocateMemory(s->shared, sizeof (int) * (size * size + 1));
 
-    if (graph != NULL) {
-        int * dist;
-        int * prev;
+    if (ret == NULL) {
+        printf("Error while allocating memory to expand tour\n");
+        exit(-1);
+    }
 
-#ifndef USE_MPI_MALLOC
-        dist = (int*) malloc(sizeof (int) * graph->size);
-        prev = (int*) malloc(sizeof (int) * graph->size);
-#else
-        MPI_Alloc_mem(sizeof (int) * graph->size, MPI_INFO_NULL, &dist);
-        MPI_Alloc_mem(sizeof (int) * graph->size, MPI_INFO_NULL, &prev);
-#endif
+    unrankCanonical(&s->unranker, 0, s->key, order);
+    ret[length++] = order[0];
 
-        if (dist == NULL || prev == NULL) {
-            printf("Error while allocating memory to run dijkstra...\n");
-            exit(-1);
+    for (i = 0; i < size; i++) {
+        int b = order[i];
+        int e = order[i + 1];
+
+        if (s->weights[b * size + e] != s->graph->edges[b * size + e]) {
+            int * prev = s->previous + b * size;
+            int count = 0;
+            while (e != b && e != UNDEFINED) {
+                s->scratch[count++] = e;
+                e = prev[e];
+            }
+            while (count-- > 0) {
+                ret[length++] = s->scratch[count];
+            }
+        } else {
+            ret[length++] = e;
         }
+    }
 
-        initDijkstra(dist, prev);
-        dist[src] = 0;
+    *walk = ret;
+    return length;
+}
 
-        do {
+/*
+ * A cheaper edge can only shorten paths that go through it, so every pair is
+ * compared against the paths entering it from either end. A dearer or removed
+ * edge only breaks the shortest path trees that used it, which the
+ * predecessor rows tell, and only those sources are run again.
+ */
+void lowerEdge(pSolver s, int u, int v, int weight) {
+    int size = s->graph->size;
+    int * du = s->stepped;
+    int * dv = s->scratch;
+    int * pu;
+    int * pv;
+    int x, y;
+
+    pu = (int*) allocateMemory(s->shared, sizeof (int) * size * 2);
+
+    if (pu == NULL) {
+        printf("Error while allocating memory to update edge\n");
+        exit(-1);
+    }
 
-            u = lowerPath(dist);
+    pv = pu + size;
 
-            graph->nodes[u]->step = TRUE;
+    /* rows u and v before any change, the graph is undirected */
+    for (x = 0; x < size; x++) {
+        du[x] = s->closure[u * size + x];
+        dv[x] = s->closure[v * size + x];
+        pu[x] = s->previous[u * size + x];
+        pv[x] = s->previous[v * size + x];
+    }
 
-            if (u == dst) /* found */ {
-                found = TRUE;
-            } else {
-                for (v = 0; v < graph->size; v++) {
-                    int edgeIdx = u * graph->size + v;
-                    if (graph->edges[edgeIdx] != 0) {
-                        int alt = dist[u] + graph->edges[edgeIdx];
-                        if (alt < dist[v]) {
-                            dist[v] = alt;
-                            prev[v] = u;
-                        }
-                    }
-                }
+    for (x = 0; x < size; x++) {
+        for (y = 0; y < size; y++) {
+            int * d = &s->closure[x * size + y];
+            int * p = &s->previous[x * size + y];
+            if (du[x] != INT_MAX && dv[y] != INT_MAX
+                    && (long long) du[x] + weight + dv[y] < *d) {
+                *d = du[x] + weight + dv[y];
+                *p = y == v ? u : pv[y];
+            }
+            if (dv[x] != INT_MAX && du[y] != INT_MAX
+                    && (long long) dv[x] + weight + du[y] < *d) {
+                *d = dv[x] + weight + du[y];
+                *p = y == u ? v : pu[y];
             }
+        }
+    }
 
-        } while (!found && !allStepped());
+    releaseMemory(s->shared, pu);
+}
 
-#ifndef USE_MPI_MALLOC
-        ret = (pPath) malloc(sizeof (Path));
-#else
-        MPI_Alloc_mem(sizeof (Path), MPI_INFO_NULL, &ret);
-#endif
+void updateSolverEdge(pSolver s, int src, int dst, int weight) {
+    int size = s->graph->size;
+    int old = s->graph->edges[src * size + dst];
+    long long key = s->key;
+    int x;
+
+    forgetWalk(s);
+
+    /*
+     * A presolved solve leaves the closure of the whole graph unbuilt, it is
+     * built by the next resolve, which still starts from the previous tour.
+     */
+    if (!s->closed || src == dst) {
+        addSolverEdge(s, src, dst, weight);
+        s->key = key;
+        s->lower = INT_MAX;
+        return;
+    }
 
-        if (ret == NULL) {
-            printf("Error while allocating memory for dijkstra\n");
-            exit(-1);
+    s->graph->edges[src * size + dst] = s->graph->edges[dst * size + src] = weight;
+
+    if (weight != 0 && (old == 0 || weight < old)) {
+        lowerEdge(s, src, dst, weight);
+    } else if (old != 0 && weight != old) {
+        for (x = 0; x < size; x++) {
+            if (s->previous[x * size + dst] == src || s->previous[x * size + src] == dst) {
+                dijkstra(s, x);
+            }
         }
+    }
 
-        ret->totalWeight = dist[u];
+    fillWeights(s);
+    /* s->key still names the previous best tour, its weight is stale */
+    s->lower = INT_MAX;
+}
 
-        while (prev[u] != UNDEFINED) {
-            lastPathNode = addPathNode(u, lastPathNode);
-            u = prev[u];
+/*
+ * Walks the indexes like getLowerPath but only accepts tours below bound.
+ * The weight of the tour is summed along its prefix, closing edge included,
+ * and once it reaches the bound every index sharing that prefix is skipped.
+ * Under a budget the bound also follows the tours found by the local search,
+ * and the walk ends early when told to stop.
+ */
+void getLowerPathBounded(pSolver s, long long start, long long end, int bound,
+        int * lower, long long * lowerKey) {
+    int size = s->graph->size;
+    int m = size - 1;
+    int order[UNRANK_MAX_NODES + 1];
+    long long i = start;
+    long long steps = 0;
+
+    *lower = bound;
+    *lowerKey = UNDEFINED;
+
+    while (i <= end) {
+        long long prefix;
+        long long skip = 1;
+        int k;
+
+        if (s->anytime != NULL && (++steps & ANYTIME_MASK) == 0) {
+            if (anytimeStopped(s->anytime)) {
+                return;
+            }
+            if (getAnytimeUpper(s->anytime) < *lower) {
+                *lower = getAnytimeUpper(s->anytime);
+            }
         }
 
-        ret->first = addPathNode(u, lastPathNode);
+        unrankCanonical(&s->unranker, 0, i, order);
 
-#ifndef USE_MPI_MALLOC
-        free(prev);
-        free(dist);
-#else
-        MPI_Free_mem(prev);
-        MPI_Free_mem(dist);
-#endif
+        prefix = (long long) s->weights[order[0] * size + order[1]]
+                + s->weights[order[m] * size + order[size]];
+
+        for (k = 2; k <= m; k++) {
+            prefix += s->weights[order[k - 1] * size + order[k]];
+            if (prefix >= *lower && k < m) {
+                skip = (long long) s->unranker.factorials[m - 1 - k];
+                break;
+            }
+        }
 
+        if (m < 2) {
+            prefix = tourWeight(s->weights, size, order);
+        }
+
+        if (k > m && prefix < *lower) {
+            *lower = (int) prefix;
+            *lowerKey = i;
+            if (s->anytime != NULL) {
+                offerAnytimeTour(s->anytime, order, *lower);
+            }
+        }
+
+        i = (i / skip + 1) * skip;
     }
 
-    return ret;
+    if (s->anytime != NULL) {
+        proveAnytime(s->anytime);
+    }
 }
 
-void createArtificialEdges(void) {
-    if (graph != NULL && artificialEdges == NULL) {
-        int i, j, size = graph->size;
-        int * buffer;
-        
-#ifndef USE_MPI_MALLOC
-        artificialEdges = (pPath *) malloc(sizeof (pPath) * size * size);
-        buffer = (int *) malloc(sizeof (int) * size * size);
-        
-#else
-        MPI_Alloc_mem(sizeof (pPath) * size * size, MPI_INFO_NULL, &artificialEdges);
-        MPI_Alloc_mem(sizeof (int) * size * size, MPI_INFO_NULL, &buffer);
-#endif
-        
-        if (artificialEdges == NULL || buffer == NULL) {
-            printf("Error while creating artificial edges\n");
-            exit(-1);
-        }
+int resolve(pSolver s, int exact) {
+    int order[UNRANK_MAX_NODES + 1];
+    int size = s->graph->size;
+
+    /* an update may have cut the graph, the previous tour is then no tour at all */
+    if (!connectedGraph(s)) {
+        s->lower = INT_MAX;
+        s->bound = 0;
+        s->key = UNDEFINED;
+        return s->lower;
+    }
 
-        for(i = 0; i < size * size; i++) {
-            buffer[i] = 0;
-            artificialEdges[i] = NULL; 
+    if (s->key == UNDEFINED) {
+        return solve(s);
+    }
+
+    forgetWalk(s);
+    createArtificialEdges(s);
+
+    /* the previous best tour, polished under the new weights, is the incumbent */
+    unrankCanonical(&s->unranker, 0, s->key, order);
+    s->lower = twoOpt(s->weights, size, order);
+    s->key = rankCanonical(&s->unranker, order);
+
+    if (exact) {
+        int lower;
+        long long key;
+
+        getLowerPathBounded(s, 0, countTours(s) - 1, s->lower, &lower, &key);
+
+        if (key != UNDEFINED) {
+            s->lower = lower;
+            s->key = key;
         }
-        
+    }
+
+    s->bound = exact ? s->lower : 0;
+    return s->lower;
+}
+
+int getSolverBound(pSolver s) {
+    return s->bound;
+}
+
+int getSolverPath(pSolver s, int ** path) {
+    int * walk;
+    int length;
+
+    if (s->key == UNDEFINED) {
+        return UNDEFINED;
+    }
+
+    *path = (int*) malloc(sizeof (int) * (s->walk != NULL ? s->walkLength : s->graph->size * s->graph->size + 1));
+
+    if (*path == NULL) {
+        printf("Error while allocating memory to expand tour\n");
+        exit(-1);
+    }
+
+    if (s->walk != NULL) {
+        memcpy(*path, s->walk, sizeof (int) * s->walkLength);
+        return s->walkLength;
+    }
+
+    createArtificialEdges(s);
+    length = getSolverWalk(s, &walk);
+    memcpy(*path, walk, sizeof (int) * length);
+    releaseMemory(s->shared, walk);
+
+    return length;
+}
+
+int getSolverSize(pSolver s) {
+    return s->graph->size;
+}
+
+int getSolverTour(pSolver s, int * order) {
+    if (s->key == UNDEFINED) {
+        return UNDEFINED;
+    }
+    unrankCanonical(&s->unranker, 0, s->key, order);
+    return s->lower;
+}
+
+void printSolverTour(pSolver s) {
+    if (s->key != UNDEFINED) {
+        pPath p;
+
+        /* a presolved solve leaves the closure of the whole graph to be built */
+        createArtificialEdges(s);
+
+        p = getPathFromIndex(s, 0, s->key);
+        printPath(p);
+        printRealPath(s, p);
+        destroyPath(p);
+    }
+}
+
+void initDijkstra(pSolver s, int * pathSizes, int * previous) {
+    int i;
+    for (i = 0; i < s->graph->size; i++) {
+        s->stepped[i] = FALSE;
+        pathSizes[i] = INT_MAX;
+        previous[i] = UNDEFINED;
+    }
+}
+
+/* breadth first over the graph edges from node 0, scratch holding the queue */
+int connectedGraph(pSolver s) {
+    int size = s->graph->size;
+    int head = 0, tail = 0;
+    int i;
+
+    for (i = 0; i < size; i++) {
+        s->stepped[i] = FALSE;
+    }
+
+    s->stepped[0] = TRUE;
+    s->scratch[tail++] = 0;
+
+    while (head < tail) {
+        int u = s->scratch[head++];
         for (i = 0; i < size; i++) {
-            for (j = 0; j < size; j++) {
-                int edge = i * size + j;
-                if (graph->edges[edge] == 0 && artificialEdges[edge] == NULL && i != j) {
-                    int reverseEdge = j * size + i;
-                    pPath p = dijkstra(i, j);
-                    pPath pReverse = dijkstra(j, i);
-                    buffer[edge] = buffer[reverseEdge] = p->totalWeight;
-                    artificialEdges[edge] = p;
-                    artificialEdges[reverseEdge] = pReverse;
-                }
+            if (!s->stepped[i] && s->graph->edges[u * size + i] != 0) {
+                s->stepped[i] = TRUE;
+                s->scratch[tail++] = i;
             }
         }
-        
-        for(i = 0; i < size * size; i++) {
-            if(buffer[i] != 0) {
-                graph->edges[i] = buffer[i];
+    }
+
+    return tail == size;
+}
+
+int allStepped(pSolver s) {
+    int i = 0;
+    for (; i < s->graph->size; i++) {
+        if (!s->stepped[i]) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+int lowerPath(pSolver s, int * paths) {
+    int i;
+    int lower = INT_MAX;
+    int lowerKey = -1;
+    for (i = 0; i < s->graph->size; i++) {
+        if (paths[i] <= lower && !s->stepped[i]) {
+            lowerKey = i;
+            lower = paths[i];
+        }
+    }
+    return lowerKey;
+}
+
+void dijkstra(pSolver s, int src) {
+
+    pGraph graph = s->graph;
+    int * dist = s->closure + src * graph->size;
+    int * prev = s->previous + src * graph->size;
+    int v;
+    int u;
+
+    initDijkstra(s, dist, prev);
+    dist[src] = 0;
+
+    do {
+
+        u = lowerPath(s, dist);
+
+        s->stepped[u] = TRUE;
+
+        if (dist[u] != INT_MAX) {
+            for (v = 0; v < graph->size; v++) {
+                int edgeIdx = u * graph->size + v;
+                if (graph->edges[edgeIdx] != 0) {
+                    int alt = dist[u] + graph->edges[edgeIdx];
+                    if (alt < dist[v]) {
+                        dist[v] = alt;
+                        prev[v] = u;
+                    }
+                }
             }
         }
-        
-        free(buffer);
+
+    } while (!allStepped(s));
+}
+
+void allocateArtificialEdges(pSolver s) {
+    if (s->closure == NULL) {
+        int capacity = s->capacity;
+
+        s->closure = (int *) allocateMemory(s->shared, sizeof (int) * capacity * capacity);
+        s->previous = (int *) allocateMemory(s->shared, sizeof (int) * capacity * capacity);
+        s->weights = (int *) allocateMemory(s->shared, sizeof (int) * capacity * capacity);
+
+        if (s->closure == NULL || s->previous == NULL || s->weights == NULL) {
+            printf("Error while creating artificial edges\n");
+            exit(-1);
+        }
+    }
+}
+
+void createArtificialEdges(pSolver s) {
+    if (s->graph != NULL && !s->closed) {
+        int i, size = s->graph->size;
+
+        allocateArtificialEdges(s);
+
+        for (i = 0; i < size; i++) {
+            dijkstra(s, i);
+        }
+
+        fillWeights(s);
+        s->closed = TRUE;
     }
 }
 
-void destroyArtificialEdges(void) {
-    if (artificialEdges != NULL) {
-        int size = graph->size;
+#ifdef USE_MPI_MALLOC
+/*
+ * Every rank runs dijkstra from its own block of sources and the rows are
+ * then gathered everywhere, so every rank ends up holding the whole closure.
+ */
+void createArtificialEdgesParallel(pSolver s, int rank, int size) {
+    if (s->graph != NULL && !s->closed) {
+        int n = s->graph->size;
+        int * counts;
+        int * displs;
         int i;
-        int j;
+
+        allocateArtificialEdges(s);
+
+        MPI_Alloc_mem(sizeof (int) * size, MPI_INFO_NULL, &counts);
+        MPI_Alloc_mem(sizeof (int) * size, MPI_INFO_NULL, &displs);
+
+        if (counts == NULL || displs == NULL) {
+            printf("Error while creating artificial edges\n");
+            exit(-1);
+        }
+
         for (i = 0; i < size; i++) {
-            for (j = 0; j < size; j++) {
-                int e = i * size + j;
-                if (artificialEdges[e] != NULL) {
-                    destroyPath(artificialEdges[e]);
-                    artificialEdges[j * size + i] = NULL;
-                }
-            }
+            int first = (int) ((long long) n * i / size);
+            int last = (int) ((long long) n * (i + 1) / size);
+            displs[i] = first * n;
+            counts[i] = (last - first) * n;
         }
 
-#ifndef USE_MPI_MALLOC
-        free(artificialEdges);
-#else
-        MPI_Free_mem(artificialEdges);
+        for (i = displs[rank] / n; i < (displs[rank] + counts[rank]) / n; i++) {
+            dijkstra(s, i);
+        }
+
+        MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL,
+                s->closure, counts, displs, MPI_INT, MPI_COMM_WORLD);
+        MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL,
+                s->previous, counts, displs, MPI_INT, MPI_COMM_WORLD);
+
+        MPI_Free_mem(counts);
+        MPI_Free_mem(displs);
+
+        fillWeights(s);
+        s->closed = TRUE;
+    }
+}
 #endif
 
+void fillWeights(pSolver s) {
+    int i, j, size = s->graph->size;
+
+    for (i = 0; i < size; i++) {
+        for (j = 0; j < size; j++) {
+            int edge = i * size + j;
+            /* an edge dearer than the shortest path between its ends is never taken */
+            if ((s->graph->edges[edge] == 0 || s->graph->edges[edge] > s->closure[edge]) && i != j) {
+                s->weights[edge] = s->closure[edge];
+            } else {
+                s->weights[edge] = s->graph->edges[edge];
+            }
+        }
+    }
+}
+
+void destroyArtificialEdges(pSolver s) {
+    if (s->closure != NULL) {
+
+        releaseMemory(s->shared, s->closure);
+        releaseMemory(s->shared, s->previous);
+        releaseMemory(s->shared, s->weights);
+
     }
+
+    s->closure = NULL;
+    s->previous = NULL;
+    s->weights = NULL;
+    s->closed = FALSE;
 }
 
 /*
@@ -743,16 +1340,12 @@ int getCircularPathWeight(int index);
 
  */
 
-static void addEdge(int srcChar, int dstChar, int weight) {
-    int src = srcChar - 'A';
-    int dst = dstChar - 'A';
-    graph->edges[src * graph->size + dst] =
-            graph->edges[dst * graph->size + src] =
-            weight;
+static void addEdge(pSolver s, int srcChar, int dstChar, int weight) {
+    addSolverEdge(s, srcChar - 'A', dstChar - 'A', weight);
 }
 
-static void printEdges() {
-    int size = graph->size;
+static void printEdges(pSolver s) {
+    int size = s->graph->size;
     int i;
     int j;
 
@@ -766,7 +1359,7 @@ static void printEdges() {
     for (i = 0; i < size; i++) {
         printf("%c", 'A' + i);
         for (j = 0; j < size; j++) {
-            printf(" %d", graph->edges[i * graph->size + j]);
+            printf(" %d", s->graph->edges[i * size + j]);
         }
         printf("\n");
     }
@@ -800,8 +1393,9 @@ void destroyPath(pPath path) {
 #endif
 }
 
-void printRealPath(pPath p) {
-    if (graph != NULL && artificialEdges != NULL) {
+void printRealPath(pSolver s, pPath p) {
+    if (s->graph != NULL && s->closed) {
+        int size = s->graph->size;
         pPathNode pathNode = p->first;
         while (pathNode != NULL) {
             if (pathNode->next == NULL) {
@@ -809,12 +1403,16 @@ void printRealPath(pPath p) {
             } else {
                 int b = pathNode->node->id - 'A';
                 int e = pathNode->next->node->id - 'A';
-                pPath realPath = artificialEdges[b * graph->size + e];
-                if (realPath != NULL) {
-                    pPathNode it = realPath->first;
-                    while (it != NULL && it->next != NULL) {
-                        printf("%c ", it->node->id);
-                        it = it->next;
+                if (s->weights[b * size + e] != s->graph->edges[b * size + e]) {
+                    /* walk the predecessors back from e, then print them forwards */
+                    int * prev = s->previous + b * size;
+                    int count = 0;
+                    while (e != b && e != UNDEFINED) {
+                        e = prev[e];
+                        s->scratch[count++] = e;
+                    }
+                    while (count-- > 0) {
+                        printf("%c ", s->graph->nodes[s->scratch[count]]->id);
                     }
                 } else {
                     printf("%c ", pathNode->node->id);
@@ -825,88 +1423,92 @@ void printRealPath(pPath p) {
     }
 }
 
-void test(int argc, char* argv[]) {
-
-    // src: http://www.emsampa.com.br/xspxrjint.htm
-    int graphSrc[6] = {
-        159, 269, 122, 118, 182, 170//, 127, 132, 35, 166, 338
-    };
+void test(int argc, char* argv[], const char * checkpointDir, int restart, int interval) {
 
     int i;
-    int tam = 1 + 6;
-    int nCombinations;
-    int taskSize;
-    int taskIni;
-    int taskEnd;
     int lower;
-    int key;
-    pPath p;
+    long long key;
+    long long nCombinations;
+    long long taskSize;
+    long long taskIni;
+    long long taskEnd;
+    pSolver solver = NULL;
 
 #ifdef USE_MPI_MALLOC
 
     int rank, size;
+    int nodes;
+    pSolver work;
+    pPresolve presolve = NULL;
     MPI_Status status;
 
     MPI_Init(&argc, &argv);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
-#endif
-    
-    nCombinations = factorial(tam - 1) / 2;
-
-#ifdef USE_MPI_MALLOC
-    
     if (rank == 0) {
 
-        createGraph(tam);
-        
 #endif
-        
+
+        solver = createSolver(6);
+        solver->verbose = TRUE;
+        addEdge(solver, 'A', 'B', 700);
+        addEdge(solver, 'A', 'C', 119);
+        addEdge(solver, 'A', 'F', 14);
+        addEdge(solver, 'B', 'C', 109);
+        addEdge(solver, 'B', 'D', 15);
+        addEdge(solver, 'C', 'D', 11);
+        addEdge(solver, 'C', 'F', 2);
+        addEdge(solver, 'D', 'E', 6);
+        addEdge(solver, 'F', 'E', 9);
+
+        nCombinations = countTours(solver);
+
 #ifdef GRAPH_PRINT_STEP
-        printf("nCombinations: %d\n", nCombinations);
+        printf("nCombinations: %lld\n", nCombinations);
 #endif
 
-        createGraph(6);
-        addEdge('A', 'B', 700);
-        addEdge('A', 'C', 119);
-        addEdge('A', 'F', 14);
-        addEdge('B', 'C', 109);
-        addEdge('B', 'D', 15);
-        addEdge('C', 'D', 11);
-        addEdge('C', 'F', 2);
-        addEdge('D', 'E', 6);
-        addEdge('F', 'E', 9);
-
-        
-#ifdef USE_MPI_MALLOC
-        
-        for(i = 1; i < size; i++) {
-            MPI_Send(&graph, 1, MPI_AINT, i, 0, MPI_COMM_WORLD);
-        }
-
-        for (i = 1; i < tam; i++) {
-            int ini = 'A';
-            addEdge('A', ini + i, graphSrc[i - 1]);
-        }
-        
+#ifndef USE_MPI_MALLOC
+        setSolverCheckpoint(solver, checkpointDir, restart, interval);
 #endif
-        
-        sequentialSolution();
+
+        sequentialSolution(solver);
 
 #ifdef USE_MPI_MALLOC
-        
+
         printf("Starting parallel run:\n");
 
-        startTimestamp();
-        createArtificialEdges();
+        startTimestamp(solver);
 
-        taskSize = taskDivision(size, nCombinations);
+        /* the ranks search the presolved graph, rank 0 maps the tour back */
+        presolve = createPresolve(solver->graph->edges, solver->graph->size);
+        nodes = getPresolveSize(presolve);
+    }
+
+    /* ship the graph itself, every rank builds its share of the closure */
+    MPI_Bcast(&nodes, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    work = createSolver(nodes);
+
+    if (rank == 0) {
+        const int * edges = getPresolveEdges(presolve);
+        for (i = 0; i < nodes * nodes; i++) {
+            work->graph->edges[i] = edges[i];
+        }
+    }
+
+    MPI_Bcast(work->graph->edges, nodes * nodes, MPI_INT, 0, MPI_COMM_WORLD);
 
+    setSolverCheckpoint(work, checkpointDir, restart, interval);
+    createArtificialEdgesParallel(work, rank, size);
+
+    nCombinations = countTours(work);
+
+    if (rank == 0) {
+        taskSize = taskDivision(size, nCombinations);
     } else {
-        int divRecv;
-        MPI_Recv(&graph, 1, MPI_AINT, 0, 0, MPI_COMM_WORLD, &status);
-        MPI_Recv(&divRecv, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, &status);
+        long long divRecv;
+        MPI_Recv(&divRecv, 1, MPI_LONG_LONG, 0, 0, MPI_COMM_WORLD, &status);
         taskSize = divRecv;
     }
 
@@ -914,46 +1516,48 @@ void test(int argc, char* argv[]) {
     taskEnd = taskIni + taskSize - 1;
 
 #ifdef GRAPH_PRINT_STEP
-    printf("%d %d %d %d\n", rank, taskSize, taskIni, taskEnd);
+    printf("%d %lld %lld %lld\n", rank, taskSize, taskIni, taskEnd);
 #endif
 
-    getLowerPath(0, taskIni, taskEnd, &lower, &key);
+    searchRange(work, 0, taskIni, taskEnd, rank, size, &lower, &key);
 
     if (rank == 0) {
         for (i = 1; i < size; i++) {
-            int l, k;
+            int l;
+            long long k;
             MPI_Recv(&l, 1, MPI_INT, i, 0, MPI_COMM_WORLD, &status);
-            MPI_Recv(&k, 1, MPI_INT, i, 0, MPI_COMM_WORLD, &status);
+            MPI_Recv(&k, 1, MPI_LONG_LONG, i, 0, MPI_COMM_WORLD, &status);
             if (lower > l) {
                 lower = l;
                 key = k;
             }
         }
 
-        printf("%d %d\n\n", lower, key);
+        work->lower = lower;
+        work->key = key;
+        mapPresolvedTour(solver, presolve, work);
 
-        p = getPathFromIndex(0, key);
+        printf("%d %lld\n\n", solver->lower, solver->key);
 
-        printRealPath(p);
+        printSolverTour(solver);
 
-        destroyPath(p);
-
-        destroyArtificialEdges();
-        finishTimestamp();
+        destroyPresolve(presolve);
 
-#endif
-        
-        destroyGraph();
+        finishTimestamp(solver);
 
-#ifdef USE_MPI_MALLOC
-        
     } else {
         MPI_Send(&lower, 1, MPI_INT, 0, 0, MPI_COMM_WORLD);
-        MPI_Send(&key, 1, MPI_INT, 0, 0, MPI_COMM_WORLD);
+        MPI_Send(&key, 1, MPI_LONG_LONG, 0, 0, MPI_COMM_WORLD);
     }
 
+    destroySolver(work);
+
+#endif
+
+    destroySolver(solver);
+
+#ifdef USE_MPI_MALLOC
     MPI_Finalize();
-    
 #endif
-    
-}
\ No newline at end of file
+
+}
@@ -1,23 +1,51 @@
 #ifndef GUARD_C_MPI_GRAPH
 #define GUARD_C_MPI_GRAPH
 
-void test(int argc, char* argv[]);
-
-void createGraph(int size);
-void destroyGraph(void);
+#include "cache.h"
 
 /*
-// return true or false
-int createGraph(int size);
-// return true or false
-int destroyGraph(void);
-// return true or false
-int createArtificialEdges(void);
-// return true or false
-int destroyArtificialEdges(void);
-// return -1 in case of failure, positive integer as the weight of the path
-int getCircularPathWeight(int index);
-*/
+ * A solver owns one instance, its closure, the scratch buffers used to search
+ * it and the best tour found. Nothing is shared between solvers, so any number
+ * of them can be used at the same time from different threads.
+ */
+typedef struct StructSolver Solver, *pSolver;
+
+// the demo search, writing checkpoints to checkpointDir unless it is NULL
+void test(int argc, char* argv[], const char * checkpointDir, int restart, int interval);
+
+pSolver createSolver(int size);
+// a solver taking its buffers from malloc in every build, for threads making no MPI calls
+pSolver createLocalSolver(int size);
+void destroySolver(pSolver solver);
+// empty the solver for an instance of size nodes, keeping its buffers when they fit
+void resetSolver(pSolver solver, int size);
+void setSolverVerbose(pSolver solver, int verbose);
+// reduce forced structure out of the graph before searching it, on by default
+void setSolverPresolve(pSolver solver, int presolve);
+// stop a solve after seconds with the best tour found so far and a lower bound, 0 for no limit
+void setSolverBudget(pSolver solver, double seconds);
+// look every solve up in cache first and keep its optimal tours there, NULL for none
+void setSolverCache(pSolver solver, pResultCache cache);
+// write checkpoints of the exhaustive search to dir every interval seconds, resuming from it
+// when restart is true, NULL for none
+void setSolverCheckpoint(pSolver solver, const char * dir, int restart, int interval);
+// nodes are numbered from 0, a weight of 0 means there is no edge
+void addSolverEdge(pSolver solver, int src, int dst, int weight);
+// return the weight of the best tour, INT_MAX when the graph is not connected
+int solve(pSolver solver);
+// change one edge, repairing an existing closure instead of rebuilding it (0 removes the edge)
+void updateSolverEdge(pSolver solver, int src, int dst, int weight);
+// start again from the previous best tour: local search, then an exact search when exact is true,
+// return INT_MAX when the graph is not connected anymore
+int resolve(pSolver solver, int exact);
+// return the weight of the best tour, order receives its size + 1 nodes
+int getSolverTour(pSolver solver, int * order);
+// return the proven lower bound of the last solve, equal to the best weight once it is optimal
+int getSolverBound(pSolver solver);
+// return the length of the closed walk of the best tour over the graph edges, -1 when
+// there is none, *path receives it (to free)
+int getSolverPath(pSolver solver, int ** path);
+int getSolverSize(pSolver solver);
+void printSolverTour(pSolver solver);
 
-#undef GUARD_C_MPI_GRAPH
 #endif
@@ -0,0 +1,434 @@
+#include "heldkarp.h"
+#include "batch.h"
+#include "query.h"
+
+#define TRUE 1
+#define FALSE 0
+#define UNDEFINED -1
+
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/*
+ * Node i + 1 is element i of the subsets. The subset c[0] < ... < c[k - 1]
+ * has the rank sum C(c[i], i + 1), which orders the subsets of a layer from
+ * 0 to C(size - 1, k) - 1 and lets a thread start anywhere in it.
+ */
+
+/* one cardinality layer mapped from its files */
+typedef struct {
+    int k;
+    long long count;
+    int * values;
+    unsigned char * parents;
+} Layer, *pLayer;
+
+typedef struct {
+    const int * weights;
+    int size;
+    const char * dir;
+    long long binomials[HELDKARP_MAX_NODES][HELDKARP_MAX_NODES + 1];
+    Layer previous;
+    Layer current;
+} HeldKarp, *pHeldKarp;
+
+typedef struct {
+    pHeldKarp hk;
+    long long begin;
+    long long end;
+} LayerTask, *pLayerTask;
+
+static void layerPath(pHeldKarp hk, int k, const char * suffix, char * path);
+static void * mapLayerFile(pHeldKarp hk, int k, const char * suffix, size_t bytes, int create);
+static void openLayer(pHeldKarp hk, pLayer layer, int k, int create);
+static void closeLayer(pLayer layer, size_t valueBytes);
+static void unrankSubset(pHeldKarp hk, long long rank, int k, int * c);
+static long long rankMask(pHeldKarp hk, unsigned int mask);
+static void * fillLayer(void * arg);
+
+void layerPath(pHeldKarp hk, int k, const char * suffix, char * path) {
+    snprintf(path, PATH_MAX, "%s/heldkarp-%d-%d.%s", hk->dir, (int) getpid(), k, suffix);
+}
+
+/* bytes of file k.suffix shared with the file, which is created or reopened */
+void * mapLayerFile(pHeldKarp hk, int k, const char * suffix, size_t bytes, int create) {
+    char path[PATH_MAX];
+    void * data;
+    int fd;
+
+    layerPath(hk, k, suffix, path);
+    fd = open(path, create ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0600);
+
+    if (fd < 0 || (create && ftruncate(fd, (off_t) bytes) != 0)) {
+        printf("Error while opening %s\n", path);
+        exit(-1);
+    }
+
+    data = mmap(NULL, bytes, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        printf("Error while mapping %s\n", path);
+        exit(-1);
+    }
+
+    return data;
+}
+
+/*
+ * A layer being built is written front to back by each thread. The layer
+ * before it is read at the ranks of the smaller subsets, close to each
+ * other, so it is paged in ahead.
+ */
+void openLayer(pHeldKarp hk, pLayer layer, int k, int create) {
+    layer->k = k;
+    layer->count = hk->binomials[hk->size - 1][k];
+    layer->values = (int*) mapLayerFile(hk, k, "dp", sizeof (int) * layer->count * k, create);
+
+    if (create) {
+        layer->parents = (unsigned char *) mapLayerFile(hk, k, "parent", layer->count * k, TRUE);
+        madvise(layer->values, sizeof (int) * layer->count * k, MADV_SEQUENTIAL);
+        madvise(layer->parents, layer->count * k, MADV_SEQUENTIAL);
+    } else {
+        layer->parents = NULL;
+        madvise(layer->values, sizeof (int) * layer->count * k, MADV_WILLNEED);
+    }
+}
+
+void closeLayer(pLayer layer, size_t valueBytes) {
+    if (layer->values != NULL) {
+        munmap(layer->values, valueBytes);
+        layer->values = NULL;
+    }
+    if (layer->parents != NULL) {
+        munmap(layer->parents, layer->count * layer->k);
+        layer->parents = NULL;
+    }
+}
+
+/* c receives the k elements of the subset of the given rank, increasing */
+void unrankSubset(pHeldKarp hk, long long rank, int k, int * c) {
+    int i;
+    int top = hk->size - 2;
+
+    for (i = k - 1; i >= 0; i--) {
+        while (hk->binomials[top][i + 1] > rank) {
+            top--;
+        }
+        c[i] = top;
+        rank -= hk->binomials[top][i + 1];
+        top--;
+    }
+}
+
+long long rankMask(pHeldKarp hk, unsigned int mask) {
+    long long rank = 0;
+    int i, k = 0;
+
+    for (i = 0; i < hk->size - 1; i++) {
+        if (mask & (1u << i)) {
+            rank += hk->binomials[i][++k];
+        }
+    }
+
+    return rank;
+}
+
+/*
+ * Every subset of the task is reached from the previous one by the
+ * successor of its rank: the lowest element that can grow by one does, and
+ * the elements below it restart from 0.
+ */
+void * fillLayer(void * arg) {
+    pLayerTask task = (pLayerTask) arg;
+    pHeldKarp hk = task->hk;
+    pLayer previous = &hk->previous;
+    pLayer current = &hk->current;
+    const int * w = hk->weights;
+    int size = hk->size;
+    int k = current->k;
+    int c[HELDKARP_MAX_NODES];
+    long long rank;
+    int p, q;
+
+    if (task->begin >= task->end) {
+        return NULL;
+    }
+
+    unrankSubset(hk, task->begin, k, c);
+
+    for (rank = task->begin; rank < task->end; rank++) {
+        int * values = current->values + rank * k;
+        unsigned char * parents = current->parents + rank * k;
+        /* rank of the subset without c[p], starting with p = 0 */
+        long long smaller = 0;
+
+        for (q = 1; q < k; q++) {
+            smaller += hk->binomials[c[q]][q];
+        }
+
+        for (p = 0; p < k; p++) {
+            int to = c[p] + 1;
+            long long best = INT_MAX;
+            int parent = 0;
+
+            if (k == 1) {
+                best = w[to];
+            } else {
+                const int * from = previous->values + smaller * (k - 1);
+
+                /* c[q] lies at q, or q - 1 past the removed c[p], in the smaller subset */
+                for (q = 0; q < k; q++) {
+                    int f, edge;
+
+                    if (q == p) {
+                        continue;
+                    }
+
+                    f = q < p ? from[q] : from[q - 1];
+                    edge = w[(c[q] + 1) * size + to];
+
+                    if (f != INT_MAX && edge != INT_MAX && (long long) f + edge < best) {
+                        best = (long long) f + edge;
+                        parent = c[q] + 1;
+                    }
+                }
+            }
+
+            values[p] = (int) best;
+            parents[p] = (unsigned char) parent;
+
+            if (p + 1 < k) {
+                smaller += hk->binomials[c[p]][p + 1] - hk->binomials[c[p + 1]][p + 1];
+            }
+        }
+
+        for (p = 0; p + 1 < k && c[p] + 1 == c[p + 1]; p++) {
+        }
+        c[p]++;
+        for (q = 0; q < p; q++) {
+            c[q] = q;
+        }
+    }
+
+    return NULL;
+}
+
+int heldKarp(const int * weights, int size, const char * dir, int threads, int * order) {
+    HeldKarp hk;
+    LayerTask * tasks;
+    pthread_t * workers;
+    char path[PATH_MAX];
+    unsigned int mask;
+    long long best = INT_MAX;
+    int end = UNDEFINED;
+    int m = size - 1;
+    int i, j, k;
+
+    if (size < 1 || size > HELDKARP_MAX_NODES) {
+        return UNDEFINED;
+    }
+
+    order[0] = order[size] = 0;
+
+    if (size == 1) {
+        return 0;
+    }
+
+    hk.weights = weights;
+    hk.size = size;
+    hk.dir = dir;
+    hk.previous.values = hk.current.values = NULL;
+    hk.previous.parents = hk.current.parents = NULL;
+
+    for (i = 0; i < HELDKARP_MAX_NODES; i++) {
+        for (j = 0; j <= HELDKARP_MAX_NODES; j++) {
+            hk.binomials[i][j] = j == 0 ? 1 : (i == 0 ? 0 : hk.binomials[i - 1][j - 1] + hk.binomials[i - 1][j]);
+        }
+    }
+
+    tasks = (LayerTask *) malloc(sizeof (LayerTask) * threads);
+    workers = (pthread_t *) malloc(sizeof (pthread_t) * threads);
+
+    if (tasks == NULL || workers == NULL) {
+        printf("Error while allocating memory to solve instance\n");
+        exit(-1);
+    }
+
+    for (k = 1; k <= m; k++) {
+        openLayer(&hk, &hk.current, k, TRUE);
+
+        for (i = 0; i < threads; i++) {
+            tasks[i].hk = &hk;
+            tasks[i].begin = hk.current.count * i / threads;
+            tasks[i].end = hk.current.count * (i + 1) / threads;
+            if (pthread_create(&workers[i], NULL, fillLayer, &tasks[i]) != 0) {
+                printf("Error while starting worker\n");
+                exit(-1);
+            }
+        }
+
+        for (i = 0; i < threads; i++) {
+            pthread_join(workers[i], NULL);
+        }
+
+        /* the values of layer k - 1 are not needed anymore, its parents stay on disk */
+        if (k > 1) {
+            closeLayer(&hk.previous, sizeof (int) * hk.previous.count * (k - 1));
+            layerPath(&hk, k - 1, "dp", path);
+            unlink(path);
+        }
+
+        munmap(hk.current.parents, hk.current.count * k);
+        hk.current.parents = NULL;
+        hk.previous = hk.current;
+    }
+
+    /* the last layer holds the single subset of every node but 0 */
+    for (j = 0; j < m; j++) {
+        int f = hk.previous.values[j];
+        int edge = weights[(j + 1) * size];
+
+        if (f != INT_MAX && edge != INT_MAX && (long long) f + edge < best) {
+            best = (long long) f + edge;
+            end = j + 1;
+        }
+    }
+
+    closeLayer(&hk.previous, sizeof (int) * hk.previous.count * m);
+    layerPath(&hk, m, "dp", path);
+    unlink(path);
+
+    /* the tour is walked backwards from its last node through the parents of each layer */
+    mask = (1u << m) - 1;
+
+    for (k = m; k >= 1; k--) {
+        unsigned char * parents;
+        int position = 0;
+
+        if (end == UNDEFINED) {
+            layerPath(&hk, k, "parent", path);
+            unlink(path);
+            continue;
+        }
+
+        for (j = 0; j < end - 1; j++) {
+            position += (mask >> j) & 1u;
+        }
+
+        parents = (unsigned char *) mapLayerFile(&hk, k, "parent", hk.binomials[m][k] * k, FALSE);
+        order[k] = end;
+        j = parents[rankMask(&hk, mask) * k + position];
+        munmap(parents, hk.binomials[m][k] * k);
+
+        layerPath(&hk, k, "parent", path);
+        unlink(path);
+
+        mask &= ~(1u << (end - 1));
+        end = j;
+    }
+
+    free(tasks);
+    free(workers);
+
+    return best == INT_MAX ? UNDEFINED : (int) best;
+}
+
+void runHeldKarp(const char * input, const char * output, const char * dir, int threads) {
+    Instance instance;
+    FILE * in = strcmp(input, "-") == 0 ? stdin : fopen(input, "r");
+    FILE * out;
+    pBaseGraph g;
+    pDijkstraScratch scratch;
+    int * weights;
+    int * nodes;
+    int tour[HELDKARP_MAX_NODES + 1];
+    int weight, i;
+    struct timespec start, now;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (in == NULL || !readInstance(in, &instance)) {
+        printf("Error while reading instance from %s\n", input);
+        exit(-1);
+    }
+
+    if (in != stdin) {
+        fclose(in);
+    }
+
+    if (instance.size < 1 || instance.size > HELDKARP_MAX_NODES) {
+        printf("Error while reading instance from %s\n", input);
+        exit(-1);
+    }
+
+    g = createBaseGraph(instance.size, 1);
+
+    for (i = 0; i < instance.count; i++) {
+        int src = instance.edges[3 * i];
+        int dst = instance.edges[3 * i + 1];
+        if (src >= 0 && dst >= 0 && src < instance.size && dst < instance.size) {
+            addBaseEdge(g, src, dst, instance.edges[3 * i + 2]);
+        }
+    }
+
+    /* the tour runs over the shortest paths between the nodes */
+    weights = (int*) malloc(sizeof (int) * instance.size * instance.size);
+    nodes = (int*) malloc(sizeof (int) * instance.size);
+
+    if (weights == NULL || nodes == NULL) {
+        printf("Error while allocating memory to solve instance\n");
+        exit(-1);
+    }
+
+    for (i = 0; i < instance.size; i++) {
+        nodes[i] = i;
+    }
+
+    scratch = createDijkstraScratch(g);
+
+    for (i = 0; i < instance.size; i++) {
+        targetDistances(g, scratch, i, nodes, instance.size, weights + i * instance.size);
+    }
+
+    destroyDijkstraScratch(scratch);
+
+    weight = heldKarp(weights, instance.size, dir, threads < 1 ? 1 : threads, tour);
+
+    out = output == NULL ? stdout : fopen(output, "w");
+
+    if (out == NULL) {
+        printf("Error while opening %s\n", output);
+        exit(-1);
+    }
+
+    if (weight < 0) {
+        fprintf(out, "%s error\n", instance.id);
+    } else {
+        fprintf(out, "%s %d", instance.id, weight);
+        for (i = 0; i <= instance.size; i++) {
+            fprintf(out, " %d", tour[i]);
+        }
+        fprintf(out, "\n");
+    }
+
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    fprintf(stderr, "Solved %d nodes in %.3f seconds\n", instance.size,
+            (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9);
+
+    free(weights);
+    free(nodes);
+    destroyBaseGraph(g);
+    destroyInstance(&instance);
+}
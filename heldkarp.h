@@ -0,0 +1,29 @@
+#ifndef GUARD_C_MPI_HELDKARP
+#define GUARD_C_MPI_HELDKARP
+
+/* the subsets of the nodes but 0 are bitmasks of one int */
+#define HELDKARP_MAX_NODES 32
+
+/*
+ * Held-Karp dynamic programming for instances past the exhaustive search.
+ * The best path from node 0 through a subset ending at one of its nodes only
+ * depends on the paths through the subsets one node smaller, so the subsets
+ * are handled a cardinality layer at a time and only the current and the
+ * previous layers are kept, in files mapped to memory so they can outgrow
+ * it. Inside a layer the subsets lie by their combinatorial rank, each one
+ * followed by the values of its end nodes in increasing order, so a layer is
+ * written front to back. The node before the end of every best path is kept
+ * in one byte per value, in a file per layer read back only to walk the best
+ * tour backwards.
+ */
+
+// weights is a symmetric size x size matrix, INT_MAX where there is no path, the layers are
+// written under dir. return the weight of the best tour, -1 when there is none,
+// order receives its size + 1 nodes from node 0
+int heldKarp(const int * weights, int size, const char * dir, int threads, int * order);
+
+// solve the first instance of input ("-" for stdin) exactly with the layers under dir,
+// writing "<id> <weight> <node> ... <node>" to output (NULL for stdout)
+void runHeldKarp(const char * input, const char * output, const char * dir, int threads);
+
+#endif
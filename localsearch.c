@@ -0,0 +1,81 @@
+#include "localsearch.h"
+
+#define TRUE 1
+#define FALSE 0
+#define UNDEFINED -1
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int tourWeight(const int * weights, int size, const int * order) {
+    int ret = 0;
+    int i;
+    for (i = 0; i < size; i++) {
+        ret += weights[order[i] * size + order[i + 1]];
+    }
+    return ret;
+}
+
+int twoOpt(const int * weights, int size, int * order) {
+    int improved = TRUE;
+
+    while (improved) {
+        int i, j;
+        improved = FALSE;
+
+        for (i = 1; i < size - 1; i++) {
+            int a = order[i - 1];
+            int b = order[i];
+
+            for (j = i + 1; j < size; j++) {
+                int c = order[j];
+                int d = order[j + 1];
+                /* replacing a-b and c-d by a-c and b-d reverses b .. c */
+                long long delta = (long long) weights[a * size + c] + weights[b * size + d]
+                        - weights[a * size + b] - weights[c * size + d];
+
+                if (delta < 0) {
+                    int l = i;
+                    int r = j;
+                    while (l < r) {
+                        int t = order[l];
+                        order[l++] = order[r];
+                        order[r--] = t;
+                    }
+                    b = order[i];
+                    improved = TRUE;
+                }
+            }
+        }
+    }
+
+    return tourWeight(weights, size, order);
+}
+
+void nearestNeighbor(const int * weights, int size, int * order) {
+    char * visited = (char*) calloc(size, sizeof (char));
+    int i, j;
+
+    if (visited == NULL) {
+        printf("Error while allocating memory to build tour\n");
+        exit(-1);
+    }
+
+    order[0] = 0;
+    visited[0] = TRUE;
+
+    for (i = 1; i < size; i++) {
+        int from = order[i - 1];
+        int next = UNDEFINED;
+        for (j = 0; j < size; j++) {
+            if (!visited[j] && (next == UNDEFINED || weights[from * size + j] < weights[from * size + next])) {
+                next = j;
+            }
+        }
+        visited[next] = TRUE;
+        order[i] = next;
+    }
+
+    order[size] = 0;
+    free(visited);
+}
@@ -0,0 +1,16 @@
+#ifndef GUARD_C_MPI_LOCALSEARCH
+#define GUARD_C_MPI_LOCALSEARCH
+
+/*
+ * Tours are arrays of size + 1 nodes starting and ending at the same node,
+ * weights is a symmetric size x size matrix. The first and last nodes are
+ * never moved.
+ */
+
+int tourWeight(const int * weights, int size, const int * order);
+// improve order with 2-opt moves until none helps, return its weight
+int twoOpt(const int * weights, int size, int * order);
+// order receives the tour from node 0 always moving to the nearest node left
+void nearestNeighbor(const int * weights, int size, int * order);
+
+#endif
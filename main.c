@@ -1,4 +1,4 @@
-/* 
+/*
  * File:   main.c
  * Author: csiqueira
  *
@@ -7,14 +7,159 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "graph.h"
+#include "checkpoint.h"
+#include "batch.h"
+#include "query.h"
+#include "decompose.h"
+#include "heldkarp.h"
+#include "meet.h"
+#include "cache.h"
+#include "construct.h"
 
 /*
- * 
+ * -c dir      write periodic checkpoints of the search to dir
+ * -r          resume from the newest complete checkpoint in dir
+ * -i seconds  interval between two checkpoints
+ * -b file     solve every instance of file ("-" for stdin)
+ * -o file     write the batch answers to file
+ * -s          serve instances from stdin to stdout
+ * -u path     serve instances from a unix socket
+ * -t threads  worker threads of the batch and server modes
+ * -a seconds  time budget of every instance in the batch and server modes, which also
+ *             lets instances too large to enumerate be toured by construction and local search
+ * -g file     answer stop queries from stdin over the base graph of file
+ * -d file     tour the large graph of file by solving clusters of it
+ * -e file     solve the graph of file exactly by dynamic programming
+ * -w dir      where the dynamic programming keeps its layers, "." by default
+ * -m file     solve the graph of file exactly by joining the best half tours
+ * -k file     keep the optimal tours of the batch and server modes in file
+ * -n file     build a tour over the graph of file from its minimum spanning tree
+ * -x method   how -n builds it: greedy (default), christofides or tree
  */
 int main(int argc, char** argv) {
-    test(argc, argv);
+    const char * checkpointDir = NULL;
+    const char * batchInput = NULL;
+    const char * batchOutput = NULL;
+    const char * socketPath = NULL;
+    const char * baseGraph = NULL;
+    const char * largeGraph = NULL;
+    const char * exactGraph = NULL;
+    const char * layerDir = ".";
+    const char * middleGraph = NULL;
+    const char * cachePath = NULL;
+    pResultCache cache = NULL;
+    const char * constructGraph = NULL;
+    int method = CONSTRUCT_GREEDY_EDGE;
+    int server = 0;
+    int restart = 0;
+    int interval = CHECKPOINT_INTERVAL;
+    int threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    double budget = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:ri:b:o:su:t:a:g:d:e:w:m:k:n:x:")) != -1) {
+        switch (opt) {
+            case 'c':
+                checkpointDir = optarg;
+                break;
+            case 'r':
+                restart = 1;
+                break;
+            case 'i':
+                interval = atoi(optarg);
+                break;
+            case 'b':
+                batchInput = optarg;
+                break;
+            case 'o':
+                batchOutput = optarg;
+                break;
+            case 's':
+                server = 1;
+                break;
+            case 'u':
+                server = 1;
+                socketPath = optarg;
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 'a':
+                budget = atof(optarg);
+                break;
+            case 'g':
+                baseGraph = optarg;
+                break;
+            case 'd':
+                largeGraph = optarg;
+                break;
+            case 'e':
+                exactGraph = optarg;
+                break;
+            case 'w':
+                layerDir = optarg;
+                break;
+            case 'm':
+                middleGraph = optarg;
+                break;
+            case 'k':
+                cachePath = optarg;
+                break;
+            case 'n':
+                constructGraph = optarg;
+                break;
+            case 'x':
+                if (strcmp(optarg, "greedy") == 0) {
+                    method = CONSTRUCT_GREEDY_EDGE;
+                    break;
+                }
+                if (strcmp(optarg, "christofides") == 0) {
+                    method = CONSTRUCT_CHRISTOFIDES;
+                    break;
+                }
+                if (strcmp(optarg, "tree") == 0) {
+                    method = CONSTRUCT_DOUBLE_TREE;
+                    break;
+                }
+                /* fall through */
+            default:
+                printf("usage: %s [-c dir [-r] [-i seconds]] [-b file [-o file]] [-s | -u path] [-t threads] [-a seconds] [-k file] [-g file] [-d file [-o file]] [-e file [-w dir] [-o file]] [-m file [-o file]] [-n file [-x greedy|christofides|tree] [-o file]]\n",
+                        argv[0]);
+                return (EXIT_FAILURE);
+        }
+    }
+
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    if (cachePath != NULL && (batchInput != NULL || server)) {
+        cache = openResultCache(cachePath, CACHE_SLOTS);
+    }
+
+    if (constructGraph != NULL) {
+        runConstruction(constructGraph, batchOutput, method, threads);
+    } else if (middleGraph != NULL) {
+        runMeetInMiddle(argc, argv, middleGraph, batchOutput, threads);
+    } else if (exactGraph != NULL) {
+        runHeldKarp(exactGraph, batchOutput, layerDir, threads);
+    } else if (largeGraph != NULL) {
+        runDecomposition(argc, argv, largeGraph, batchOutput, threads);
+    } else if (baseGraph != NULL) {
+        runQueries(baseGraph, stdin, stdout, QUERY_CACHE_SIZE);
+    } else if (batchInput != NULL) {
+        runBatch(argc, argv, batchInput, batchOutput, threads, budget, cache);
+    } else if (server) {
+        runServer(socketPath, threads, budget, cache);
+    } else {
+        test(argc, argv, checkpointDir, restart, interval);
+    }
+
+    closeResultCache(cache);
+
     return (EXIT_SUCCESS);
 }
-
@@ -0,0 +1,887 @@
+#include "meet.h"
+#include "batch.h"
+#include "query.h"
+
+#define TRUE 1
+#define FALSE 0
+#define UNDEFINED -1
+
+#ifdef USE_MPI_MALLOC
+#include <mpi.h>
+#endif
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* a subset is never empty, so 0 marks a free slot */
+#define MEET_EMPTY 0u
+#define MEET_MIN_CAPACITY 64
+#define MEET_GOLDEN 0x9E3779B97F4A7C15ULL
+
+/*
+ * Open addressing on the bitmask of the subset. Its slot holds a row with
+ * the cost of the cheapest path to each of its nodes, in increasing order,
+ * all the subsets of a table having width nodes.
+ */
+typedef struct {
+    unsigned int * keys;
+    int * costs;
+    int width;
+    long long capacity;
+    long long count;
+} HalfTable, *pHalfTable;
+
+typedef struct {
+    const int * weights;
+    int size;
+    int threads;
+    int rank;
+    int ranks;
+    /* nodes in the paths being grown */
+    int k;
+    /* shards of the paths through k - 1 and k nodes */
+    pHalfTable previous;
+    pHalfTable current;
+    /* the paths joined, through the first half and its complement */
+    pHalfTable halves;
+    pHalfTable others;
+    /* best join of each thread: weight, subset of the first half, its last node and the first of the other */
+    long long * bestWeights;
+    unsigned int * bestMasks;
+    int * bestEnds;
+    int * bestStarts;
+    /* rows grown for the subsets of other ranks, per thread and rank: subset, node, cost */
+    int ** outgoing;
+    long long * outgoingCounts;
+    long long * outgoingCapacities;
+    /* rows grown by the other ranks for the subsets of this one */
+    int * incoming;
+    long long incomingCount;
+} Meet, *pMeet;
+
+typedef void (*MeetTask)(pMeet mm, int shard);
+
+typedef struct {
+    pMeet mm;
+    MeetTask task;
+    int shard;
+} ShardRun, *pShardRun;
+
+static unsigned long long mixKey(unsigned long long key);
+static int shardOf(pMeet mm, unsigned int mask);
+static int ownerOf(pMeet mm, unsigned int mask);
+static pHalfTable createShards(int threads, int width, long long expected);
+static void destroyShards(pHalfTable shards, int threads);
+static int * keepRow(pHalfTable t, unsigned int mask);
+static int * findRow(pHalfTable t, unsigned int mask);
+static int positionOf(unsigned int mask, int node);
+static void * shardWorker(void * arg);
+static void runShards(pMeet mm, MeetTask task);
+static void growShard(pMeet mm, int shard);
+static void sendRow(pMeet mm, int shard, int owner, unsigned int mask, int node, int cost);
+static void joinShard(pMeet mm, int shard);
+#ifdef USE_MPI_MALLOC
+static void exchangeRows(pMeet mm);
+static void receiveShard(pMeet mm, int shard);
+#endif
+static void halfPath(const int * weights, int size, unsigned int mask, int end, int * path);
+
+unsigned long long mixKey(unsigned long long key) {
+    key *= MEET_GOLDEN;
+    return key ^ (key >> 29);
+}
+
+int shardOf(pMeet mm, unsigned int mask) {
+    return (int) ((mixKey(mask) >> 32) % (unsigned long long) mm->threads);
+}
+
+/*
+ * The rank holding mask. A subset shares its owner with its complement, so
+ * the join finds both halves on the same rank.
+ */
+int ownerOf(pMeet mm, unsigned int mask) {
+    unsigned int all = (unsigned int) ((1ULL << (mm->size - 1)) - 1);
+    unsigned int rest = all & ~mask;
+    int count = 2 * __builtin_popcount(mask);
+    unsigned int key = count < mm->size - 1 ? mask : count > mm->size - 1 ? rest : mask < rest ? mask : rest;
+
+    return (int) (mixKey(key) % (unsigned long long) mm->ranks);
+}
+
+/* room for the rows of expected subsets spread over the shards, so they rarely grow */
+pHalfTable createShards(int threads, int width, long long expected) {
+    pHalfTable shards = (pHalfTable) malloc(sizeof (HalfTable) * threads);
+    long long capacity = MEET_MIN_CAPACITY;
+    int i;
+
+    while (capacity < 2 * (expected / threads + expected / threads / 8 + 1)) {
+        capacity *= 2;
+    }
+
+    if (shards == NULL) {
+        printf("Error while allocating memory for half paths\n");
+        exit(-1);
+    }
+
+    for (i = 0; i < threads; i++) {
+        shards[i].width = width;
+        shards[i].capacity = capacity;
+        shards[i].count = 0;
+        shards[i].keys = (unsigned int *) calloc(capacity, sizeof (unsigned int));
+        shards[i].costs = (int*) malloc(sizeof (int) * capacity * width);
+
+        if (shards[i].keys == NULL || shards[i].costs == NULL) {
+            printf("Error while allocating memory for half paths\n");
+            exit(-1);
+        }
+    }
+
+    return shards;
+}
+
+void destroyShards(pHalfTable shards, int threads) {
+    int i;
+
+    if (shards == NULL) {
+        return;
+    }
+
+    for (i = 0; i < threads; i++) {
+        free(shards[i].keys);
+        free(shards[i].costs);
+    }
+
+    free(shards);
+}
+
+/* return the row of mask, added with no path yet when it is missing */
+int * keepRow(pHalfTable t, unsigned int mask) {
+    long long slots;
+    long long i;
+    int j;
+
+    /* at most half full, so probes stay short */
+    if (2 * (t->count + 1) > t->capacity) {
+        HalfTable grown;
+
+        grown.width = t->width;
+        grown.capacity = 2 * t->capacity;
+        grown.count = 0;
+        grown.keys = (unsigned int *) calloc(grown.capacity, sizeof (unsigned int));
+        grown.costs = (int*) malloc(sizeof (int) * grown.capacity * grown.width);
+
+        if (grown.keys == NULL || grown.costs == NULL) {
+            printf("Error while allocating memory for half paths\n");
+            exit(-1);
+        }
+
+        for (i = 0; i < t->capacity; i++) {
+            if (t->keys[i] != MEET_EMPTY) {
+                memcpy(keepRow(&grown, t->keys[i]), t->costs + i * t->width, sizeof (int) * t->width);
+            }
+        }
+
+        free(t->keys);
+        free(t->costs);
+        *t = grown;
+    }
+
+    slots = t->capacity - 1;
+    i = (long long) (mixKey(mask) & (unsigned long long) slots);
+
+    while (t->keys[i] != MEET_EMPTY && t->keys[i] != mask) {
+        i = (i + 1) & slots;
+    }
+
+    if (t->keys[i] == MEET_EMPTY) {
+        t->keys[i] = mask;
+        t->count++;
+        for (j = 0; j < t->width; j++) {
+            t->costs[i * t->width + j] = INT_MAX;
+        }
+    }
+
+    return t->costs + i * t->width;
+}
+
+/* return NULL when no path goes through mask */
+int * findRow(pHalfTable t, unsigned int mask) {
+    long long slots = t->capacity - 1;
+    long long i = (long long) (mixKey(mask) & (unsigned long long) slots);
+
+    while (t->keys[i] != MEET_EMPTY) {
+        if (t->keys[i] == mask) {
+            return t->costs + i * t->width;
+        }
+        i = (i + 1) & slots;
+    }
+
+    return NULL;
+}
+
+/* the place of node in the row of mask */
+int positionOf(unsigned int mask, int node) {
+    return __builtin_popcount(mask & ((1u << (node - 1)) - 1));
+}
+
+void * shardWorker(void * arg) {
+    pShardRun run = (pShardRun) arg;
+    run->task(run->mm, run->shard);
+    return NULL;
+}
+
+/* run task once per shard, each on its own thread */
+void runShards(pMeet mm, MeetTask task) {
+    pthread_t * workers = (pthread_t*) malloc(sizeof (pthread_t) * mm->threads);
+    pShardRun runs = (pShardRun) malloc(sizeof (ShardRun) * mm->threads);
+    int i;
+
+    if (workers == NULL || runs == NULL) {
+        printf("Error while allocating memory for workers\n");
+        exit(-1);
+    }
+
+    for (i = 0; i < mm->threads; i++) {
+        runs[i].mm = mm;
+        runs[i].task = task;
+        runs[i].shard = i;
+        if (pthread_create(&workers[i], NULL, shardWorker, &runs[i]) != 0) {
+            printf("Error while starting worker\n");
+            exit(-1);
+        }
+    }
+
+    for (i = 0; i < mm->threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    free(workers);
+    free(runs);
+}
+
+/*
+ * Every subset of k - 1 nodes is stretched to each node it misses, through
+ * the cheapest of its paths. Each rank only holds the subsets it owns, and
+ * the paths grown from them into subsets of other ranks are sent to their
+ * owners. All threads read every shard of the smaller subsets but each one
+ * only keeps the subsets of its own shard, and sends those grown from its
+ * own shard, so nothing is locked.
+ */
+void growShard(pMeet mm, int shard) {
+    const int * w = mm->weights;
+    int size = mm->size;
+    pHalfTable target = &mm->current[shard];
+    int nodes[MEET_MAX_NODES];
+    int s, v, j;
+    long long i;
+
+    if (mm->k == 1) {
+        for (v = 1; v < size; v++) {
+            unsigned int mask = 1u << (v - 1);
+            if (ownerOf(mm, mask) == mm->rank && shardOf(mm, mask) == shard) {
+                keepRow(target, mask)[0] = w[v];
+            }
+        }
+        return;
+    }
+
+    for (s = 0; s < mm->threads; s++) {
+        pHalfTable source = &mm->previous[s];
+
+        for (i = 0; i < source->capacity; i++) {
+            unsigned int mask = source->keys[i];
+            const int * costs = source->costs + i * source->width;
+            int count = 0;
+
+            if (mask == MEET_EMPTY) {
+                continue;
+            }
+
+            for (v = 1; v < size; v++) {
+                if (mask & (1u << (v - 1))) {
+                    nodes[count++] = v;
+                }
+            }
+
+            for (v = 1; v < size; v++) {
+                unsigned int grown = mask | (1u << (v - 1));
+                long long best = INT_MAX;
+                int owner;
+                int * row;
+
+                if (grown == mask) {
+                    continue;
+                }
+
+                owner = ownerOf(mm, grown);
+
+                if (owner == mm->rank ? shardOf(mm, grown) != shard : s != shard) {
+                    continue;
+                }
+
+                for (j = 0; j < count; j++) {
+                    int edge = w[nodes[j] * size + v];
+                    if (costs[j] != INT_MAX && edge != INT_MAX && (long long) costs[j] + edge < best) {
+                        best = (long long) costs[j] + edge;
+                    }
+                }
+
+                if (best < INT_MAX && owner != mm->rank) {
+                    sendRow(mm, shard, owner, grown, v, (int) best);
+                } else if (best < INT_MAX) {
+                    row = keepRow(target, grown);
+                    j = positionOf(grown, v);
+                    if (best < row[j]) {
+                        row[j] = (int) best;
+                    }
+                }
+            }
+        }
+    }
+}
+
+/* queue the cost of the path through mask to node for its owner */
+void sendRow(pMeet mm, int shard, int owner, unsigned int mask, int node, int cost) {
+    int queue = shard * mm->ranks + owner;
+    int * rows = mm->outgoing[queue];
+
+    if (mm->outgoingCounts[queue] + 3 > mm->outgoingCapacities[queue]) {
+        mm->outgoingCapacities[queue] = 2 * mm->outgoingCapacities[queue] + 3 * MEET_MIN_CAPACITY;
+        rows = (int*) realloc(rows, sizeof (int) * mm->outgoingCapacities[queue]);
+
+        if (rows == NULL) {
+            printf("Error while allocating memory for half paths\n");
+            exit(-1);
+        }
+
+        mm->outgoing[queue] = rows;
+    }
+
+    rows[mm->outgoingCounts[queue]++] = (int) mask;
+    rows[mm->outgoingCounts[queue]++] = node;
+    rows[mm->outgoingCounts[queue]++] = cost;
+}
+
+#ifdef USE_MPI_MALLOC
+/* every rank gets the paths the others grew into its subsets */
+void exchangeRows(pMeet mm) {
+    int * sendCounts = (int*) calloc(mm->ranks, sizeof (int));
+    int * sendOffsets = (int*) malloc(sizeof (int) * mm->ranks);
+    int * receiveCounts = (int*) malloc(sizeof (int) * mm->ranks);
+    int * receiveOffsets = (int*) malloc(sizeof (int) * mm->ranks);
+    long long sent = 0;
+    long long received = 0;
+    int * rows;
+    int t, r;
+
+    if (sendCounts == NULL || sendOffsets == NULL || receiveCounts == NULL || receiveOffsets == NULL) {
+        printf("Error while allocating memory for half paths\n");
+        exit(-1);
+    }
+
+    for (r = 0; r < mm->ranks; r++) {
+        long long count = 0;
+
+        for (t = 0; t < mm->threads; t++) {
+            count += mm->outgoingCounts[t * mm->ranks + r];
+        }
+
+        if (sent + count > INT_MAX) {
+            printf("Error while sending half paths\n");
+            exit(-1);
+        }
+
+        sendOffsets[r] = (int) sent;
+        sendCounts[r] = (int) count;
+        sent += count;
+    }
+
+    rows = (int*) malloc(sizeof (int) * (sent + 1));
+
+    if (rows == NULL) {
+        printf("Error while allocating memory for half paths\n");
+        exit(-1);
+    }
+
+    for (r = 0; r < mm->ranks; r++) {
+        long long at = sendOffsets[r];
+
+        for (t = 0; t < mm->threads; t++) {
+            int queue = t * mm->ranks + r;
+            memcpy(rows + at, mm->outgoing[queue], sizeof (int) * mm->outgoingCounts[queue]);
+            at += mm->outgoingCounts[queue];
+            mm->outgoingCounts[queue] = 0;
+        }
+    }
+
+    MPI_Alltoall(sendCounts, 1, MPI_INT, receiveCounts, 1, MPI_INT, MPI_COMM_WORLD);
+
+    for (r = 0; r < mm->ranks; r++) {
+        if (received + receiveCounts[r] > INT_MAX) {
+            printf("Error while receiving half paths\n");
+            exit(-1);
+        }
+
+        receiveOffsets[r] = (int) received;
+        received += receiveCounts[r];
+    }
+
+    free(mm->incoming);
+    mm->incoming = (int*) malloc(sizeof (int) * (received + 1));
+
+    if (mm->incoming == NULL) {
+        printf("Error while allocating memory for half paths\n");
+        exit(-1);
+    }
+
+    MPI_Alltoallv(rows, sendCounts, sendOffsets, MPI_INT,
+            mm->incoming, receiveCounts, receiveOffsets, MPI_INT, MPI_COMM_WORLD);
+    mm->incomingCount = received;
+
+    free(rows);
+    free(sendCounts);
+    free(sendOffsets);
+    free(receiveCounts);
+    free(receiveOffsets);
+}
+
+/* keep the paths received for the subsets of the shard */
+void receiveShard(pMeet mm, int shard) {
+    pHalfTable target = &mm->current[shard];
+    long long i;
+
+    for (i = 0; i < mm->incomingCount; i += 3) {
+        unsigned int mask = (unsigned int) mm->incoming[i];
+        int * row;
+        int j;
+
+        if (shardOf(mm, mask) != shard) {
+            continue;
+        }
+
+        row = keepRow(target, mask);
+        j = positionOf(mask, mm->incoming[i + 1]);
+        if (mm->incoming[i + 2] < row[j]) {
+            row[j] = mm->incoming[i + 2];
+        }
+    }
+}
+#endif
+
+/* a rank only holds the subsets it owns and their complements */
+void joinShard(pMeet mm, int shard) {
+    const int * w = mm->weights;
+    int size = mm->size;
+    unsigned int all = (unsigned int) ((1ULL << (size - 1)) - 1);
+    pHalfTable halves = &mm->halves[shard];
+    int nodes[MEET_MAX_NODES];
+    int rests[MEET_MAX_NODES];
+    long long i;
+
+    mm->bestWeights[shard] = LLONG_MAX;
+
+    for (i = 0; i < halves->capacity; i++) {
+        unsigned int mask = halves->keys[i];
+        const int * costs = halves->costs + i * halves->width;
+        const int * back;
+        unsigned int rest;
+        int count = 0;
+        int restCount = 0;
+        int v, e, f;
+
+        if (mask == MEET_EMPTY) {
+            continue;
+        }
+
+        rest = all & ~mask;
+        back = findRow(&mm->others[shardOf(mm, rest)], rest);
+
+        if (back == NULL) {
+            continue;
+        }
+
+        for (v = 1; v < size; v++) {
+            if (mask & (1u << (v - 1))) {
+                nodes[count++] = v;
+            } else {
+                rests[restCount++] = v;
+            }
+        }
+
+        for (e = 0; e < count; e++) {
+            if (costs[e] == INT_MAX) {
+                continue;
+            }
+
+            for (f = 0; f < restCount; f++) {
+                int edge = w[nodes[e] * size + rests[f]];
+                long long weight;
+
+                if (back[f] == INT_MAX || edge == INT_MAX) {
+                    continue;
+                }
+
+                weight = (long long) costs[e] + edge + back[f];
+
+                if (weight < mm->bestWeights[shard]) {
+                    mm->bestWeights[shard] = weight;
+                    mm->bestMasks[shard] = mask;
+                    mm->bestEnds[shard] = nodes[e];
+                    mm->bestStarts[shard] = rests[f];
+                }
+            }
+        }
+    }
+}
+
+/*
+ * path receives the nodes of mask in the order of the best path from node 0
+ * through them to end, by a dynamic program over the subsets of mask alone.
+ */
+void halfPath(const int * weights, int size, unsigned int mask, int end, int * path) {
+    int nodes[MEET_MAX_NODES];
+    int count = 0;
+    int last = UNDEFINED;
+    int * dp;
+    signed char * parents;
+    unsigned int sub, full;
+    int i, j, v;
+
+    for (v = 1; v < size; v++) {
+        if (mask & (1u << (v - 1))) {
+            if (v == end) {
+                last = count;
+            }
+            nodes[count++] = v;
+        }
+    }
+
+    full = (1u << count) - 1;
+    dp = (int*) malloc(sizeof (int) * ((size_t) full + 1) * count);
+    parents = (signed char *) malloc(((size_t) full + 1) * count);
+
+    if (dp == NULL || parents == NULL) {
+        printf("Error while allocating memory for half paths\n");
+        exit(-1);
+    }
+
+    for (i = 0; i < (int) (full + 1) * count; i++) {
+        dp[i] = INT_MAX;
+        parents[i] = UNDEFINED;
+    }
+
+    for (j = 0; j < count; j++) {
+        dp[(1u << j) * count + j] = weights[nodes[j]];
+    }
+
+    for (sub = 1; sub <= full; sub++) {
+        for (j = 0; j < count; j++) {
+            int cost = dp[sub * count + j];
+
+            if (!(sub & (1u << j)) || cost == INT_MAX) {
+                continue;
+            }
+
+            for (i = 0; i < count; i++) {
+                unsigned int grown = sub | (1u << i);
+                int edge = weights[nodes[j] * size + nodes[i]];
+
+                if (grown != sub && edge != INT_MAX && cost + edge < dp[grown * count + i]) {
+                    dp[grown * count + i] = cost + edge;
+                    parents[grown * count + i] = (signed char) j;
+                }
+            }
+        }
+    }
+
+    for (sub = full, i = count - 1, j = last; i >= 0; i--) {
+        int before = parents[sub * count + j];
+        path[i] = nodes[j];
+        sub &= ~(1u << j);
+        j = before;
+    }
+
+    free(dp);
+    free(parents);
+}
+
+int meetInMiddle(const int * weights, int size, int threads, int * order) {
+    Meet mm;
+    int path[MEET_MAX_NODES];
+    long long best = LLONG_MAX;
+    /* subsets of k of the nodes but 0, C(size - 1, k) */
+    long long paths = 1;
+    int half = (size - 1) / 2;
+    int winner = UNDEFINED;
+    int i;
+
+    if (size < 1 || size > MEET_MAX_NODES) {
+        return UNDEFINED;
+    }
+
+    order[0] = order[size] = 0;
+
+    if (size == 1) {
+        return 0;
+    }
+
+    if (size == 2) {
+        order[1] = 1;
+        return weights[1] == INT_MAX ? UNDEFINED : 2 * weights[1];
+    }
+
+    mm.weights = weights;
+    mm.size = size;
+    mm.threads = threads < 1 ? 1 : threads;
+    mm.rank = 0;
+    mm.ranks = 1;
+    mm.previous = NULL;
+    mm.current = NULL;
+    mm.incoming = NULL;
+    mm.incomingCount = 0;
+
+#ifdef USE_MPI_MALLOC
+    {
+        int initialized;
+        MPI_Initialized(&initialized);
+        if (initialized) {
+            MPI_Comm_rank(MPI_COMM_WORLD, &mm.rank);
+            MPI_Comm_size(MPI_COMM_WORLD, &mm.ranks);
+        }
+    }
+#endif
+
+    mm.bestWeights = (long long *) malloc(sizeof (long long) * mm.threads);
+    mm.bestMasks = (unsigned int *) malloc(sizeof (unsigned int) * mm.threads);
+    mm.bestEnds = (int*) malloc(sizeof (int) * mm.threads);
+    mm.bestStarts = (int*) malloc(sizeof (int) * mm.threads);
+
+    mm.outgoing = (int**) calloc(mm.threads * mm.ranks, sizeof (int*));
+    mm.outgoingCounts = (long long *) calloc(mm.threads * mm.ranks, sizeof (long long));
+    mm.outgoingCapacities = (long long *) calloc(mm.threads * mm.ranks, sizeof (long long));
+
+    if (mm.bestWeights == NULL || mm.bestMasks == NULL || mm.bestEnds == NULL || mm.bestStarts == NULL
+            || mm.outgoing == NULL || mm.outgoingCounts == NULL || mm.outgoingCapacities == NULL) {
+        printf("Error while allocating memory for half paths\n");
+        exit(-1);
+    }
+
+    /* the other half holds one node more when the nodes but 0 are odd */
+    for (mm.k = 1; mm.k <= size - 1 - half; mm.k++) {
+        if (mm.k > 2) {
+            destroyShards(mm.previous, mm.threads);
+        }
+        paths = paths * (size - mm.k) / mm.k;
+        mm.previous = mm.current;
+        mm.current = createShards(mm.threads, mm.k, paths / mm.ranks);
+        runShards(&mm, growShard);
+#ifdef USE_MPI_MALLOC
+        if (mm.ranks > 1) {
+            exchangeRows(&mm);
+            runShards(&mm, receiveShard);
+        }
+#endif
+    }
+
+    mm.others = mm.current;
+    mm.halves = size - 1 - half == half ? mm.current : mm.previous;
+
+    runShards(&mm, joinShard);
+
+    for (i = 0; i < mm.threads; i++) {
+        if (mm.bestWeights[i] < best) {
+            best = mm.bestWeights[i];
+            winner = i;
+        }
+    }
+
+#ifdef USE_MPI_MALLOC
+    if (mm.ranks > 1) {
+        struct {
+            int weight;
+            int rank;
+        } mine, all;
+        int join[3] = {0, 0, 0};
+
+        mine.weight = best == LLONG_MAX ? INT_MAX : (int) best;
+        mine.rank = mm.rank;
+        MPI_Allreduce(&mine, &all, 1, MPI_2INT, MPI_MINLOC, MPI_COMM_WORLD);
+
+        if (winner != UNDEFINED) {
+            join[0] = (int) mm.bestMasks[winner];
+            join[1] = mm.bestEnds[winner];
+            join[2] = mm.bestStarts[winner];
+        }
+
+        MPI_Bcast(join, 3, MPI_INT, all.rank, MPI_COMM_WORLD);
+
+        best = all.weight == INT_MAX ? LLONG_MAX : all.weight;
+        winner = 0;
+        mm.bestMasks[0] = (unsigned int) join[0];
+        mm.bestEnds[0] = join[1];
+        mm.bestStarts[0] = join[2];
+    }
+#endif
+
+    if (best != LLONG_MAX) {
+        unsigned int all = (unsigned int) ((1ULL << (size - 1)) - 1);
+        unsigned int mask = mm.bestMasks[winner];
+
+        /* out through the first half, back through the other one reversed */
+        halfPath(weights, size, mask, mm.bestEnds[winner], path);
+        for (i = 0; i < half; i++) {
+            order[1 + i] = path[i];
+        }
+
+        halfPath(weights, size, all & ~mask, mm.bestStarts[winner], path);
+        for (i = 0; i < size - 1 - half; i++) {
+            order[size - 1 - i] = path[i];
+        }
+    }
+
+    if (mm.previous != mm.current) {
+        destroyShards(mm.previous, mm.threads);
+    }
+    destroyShards(mm.current, mm.threads);
+    free(mm.bestWeights);
+    free(mm.bestMasks);
+    free(mm.bestEnds);
+    free(mm.bestStarts);
+    for (i = 0; i < mm.threads * mm.ranks; i++) {
+        free(mm.outgoing[i]);
+    }
+    free(mm.outgoing);
+    free(mm.outgoingCounts);
+    free(mm.outgoingCapacities);
+    free(mm.incoming);
+
+    return best == LLONG_MAX ? UNDEFINED : (int) best;
+}
+
+void runMeetInMiddle(int argc, char* argv[], const char * input, const char * output, int threads) {
+    Instance instance;
+    pBaseGraph g;
+    pDijkstraScratch scratch;
+    int * weights;
+    int * nodes;
+    int tour[MEET_MAX_NODES + 1];
+    int weight, i;
+    int rank = 0;
+    struct timespec start, now;
+
+#ifdef USE_MPI_MALLOC
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+#endif
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (rank == 0) {
+        FILE * in = strcmp(input, "-") == 0 ? stdin : fopen(input, "r");
+
+        if (in == NULL || !readInstance(in, &instance)) {
+            printf("Error while reading instance from %s\n", input);
+            exit(-1);
+        }
+
+        if (in != stdin) {
+            fclose(in);
+        }
+    }
+
+#ifdef USE_MPI_MALLOC
+    /* only rank 0 reads, the others get the edges */
+    MPI_Bcast(instance.id, BATCH_ID_SIZE, MPI_CHAR, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&instance.size, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&instance.count, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    if (rank != 0) {
+        instance.edges = (int*) malloc(sizeof (int) * 3 * (instance.count + 1));
+        if (instance.edges == NULL) {
+            printf("Error while allocating memory to read instance\n");
+            exit(-1);
+        }
+    }
+
+    MPI_Bcast(instance.edges, 3 * instance.count, MPI_INT, 0, MPI_COMM_WORLD);
+#endif
+
+    if (instance.size < 1 || instance.size > MEET_MAX_NODES) {
+        printf("Error while reading instance from %s\n", input);
+        exit(-1);
+    }
+
+    g = createBaseGraph(instance.size, 1);
+
+    for (i = 0; i < instance.count; i++) {
+        int src = instance.edges[3 * i];
+        int dst = instance.edges[3 * i + 1];
+        if (src >= 0 && dst >= 0 && src < instance.size && dst < instance.size) {
+            addBaseEdge(g, src, dst, instance.edges[3 * i + 2]);
+        }
+    }
+
+    /* the tour runs over the shortest paths between the nodes */
+    weights = (int*) malloc(sizeof (int) * instance.size * instance.size);
+    nodes = (int*) malloc(sizeof (int) * instance.size);
+
+    if (weights == NULL || nodes == NULL) {
+        printf("Error while allocating memory to solve instance\n");
+        exit(-1);
+    }
+
+    for (i = 0; i < instance.size; i++) {
+        nodes[i] = i;
+    }
+
+    scratch = createDijkstraScratch(g);
+
+    for (i = 0; i < instance.size; i++) {
+        targetDistances(g, scratch, i, nodes, instance.size, weights + i * instance.size);
+    }
+
+    destroyDijkstraScratch(scratch);
+
+    weight = meetInMiddle(weights, instance.size, threads, tour);
+
+    if (rank == 0) {
+        FILE * out = output == NULL ? stdout : fopen(output, "w");
+
+        if (out == NULL) {
+            printf("Error while opening %s\n", output);
+            exit(-1);
+        }
+
+        if (weight < 0) {
+            fprintf(out, "%s error\n", instance.id);
+        } else {
+            fprintf(out, "%s %d", instance.id, weight);
+            for (i = 0; i <= instance.size; i++) {
+                fprintf(out, " %d", tour[i]);
+            }
+            fprintf(out, "\n");
+        }
+
+        if (out != stdout) {
+            fclose(out);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        fprintf(stderr, "Solved %d nodes in %.3f seconds\n", instance.size,
+                (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9);
+    }
+
+    free(weights);
+    free(nodes);
+    destroyBaseGraph(g);
+    destroyInstance(&instance);
+
+#ifdef USE_MPI_MALLOC
+    MPI_Finalize();
+#endif
+}
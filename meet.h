@@ -0,0 +1,31 @@
+#ifndef GUARD_C_MPI_MEET
+#define GUARD_C_MPI_MEET
+
+/* the subsets of the nodes but 0 are bitmasks of one int */
+#define MEET_MAX_NODES 32
+
+/*
+ * Meet in the middle: every tour from node 0 is a path from node 0 through
+ * half of the other nodes, one edge, and a path back to node 0 through the
+ * other half. The best path through each subset of half the size to each of
+ * its nodes is kept in hash tables keyed by the bitmask of the subset and
+ * the node, grown one node at a time so only two sizes are held at once, and
+ * every subset is then joined with its complement.
+ *
+ * Every subset is owned by one MPI rank, which shares it with its complement,
+ * and a rank only holds the subsets it owns: the paths it grows into subsets
+ * of other ranks are sent to their owners by MPI_Alltoallv after each size,
+ * and every join is made where both halves are. The tables of a rank are
+ * split in shards by subset, each shard filled by one thread.
+ */
+
+// weights is a symmetric size x size matrix, INT_MAX where there is no path.
+// return the weight of the best tour, -1 when there is none, order receives
+// its size + 1 nodes from node 0
+int meetInMiddle(const int * weights, int size, int threads, int * order);
+
+// solve the first instance of input ("-" for stdin), writing "<id> <weight> <node> ... <node>"
+// to output (NULL for stdout)
+void runMeetInMiddle(int argc, char* argv[], const char * input, const char * output, int threads);
+
+#endif
@@ -0,0 +1,572 @@
+#include "presolve.h"
+
+#define TRUE 1
+#define FALSE 0
+#define UNDEFINED -1
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* nodes always left to the search */
+#define PRESOLVE_MIN_NODES 3
+
+#define PRESOLVE_PENDANT 0
+#define PRESOLVE_CHAIN 1
+
+typedef struct {
+    int kind;
+    /* the pendant node, or the node standing for the chain */
+    int node;
+    /* the neighbor of the pendant, or the ends of the chain */
+    int a;
+    int b;
+    /*
+     * chain[0 .. length - 1] from a to b. When the chain is not walked
+     * through, chain[0 .. gap - 1] are reached from a and
+     * chain[gap .. length - 1] from b.
+     */
+    int length;
+    int gap;
+    int * chain;
+} Reduction, *pReduction;
+
+struct StructPresolve {
+    int size;
+    /* size x size, edges between the nodes still alive */
+    int * edges;
+    int * alive;
+    int * degree;
+    int left;
+    int offset;
+    /* node of the working graph of every reduced node */
+    int * nodes;
+    int * reduced;
+    pReduction reductions;
+    int count;
+    int capacity;
+};
+
+typedef struct {
+    int * nodes;
+    int length;
+    int capacity;
+} Walk, *pWalk;
+
+static void setEdge(pPresolve p, int u, int v, int weight);
+static pReduction pushReduction(pPresolve p, int kind);
+static int removeDominated(pPresolve p);
+static int removePendants(pPresolve p);
+static int contractChains(pPresolve p);
+static int walkChain(pPresolve p, int from, int cur, int * visited, int * out, int * end);
+static int otherNeighbor(pPresolve p, int v, int from);
+static void pushNode(pWalk w, int node);
+static void pushSide(pWalk w, pReduction r, int fromA);
+static void insertAfter(pWalk w, int node, pWalk seq);
+static void undoPendant(pWalk w, pReduction r);
+static void undoChain(pWalk w, pReduction r);
+
+pPresolve createPresolve(const int * edges, int size) {
+    pPresolve p = (pPresolve) malloc(sizeof (Presolve));
+    int changed = TRUE;
+    int i, j;
+
+    if (p == NULL) {
+        printf("Error while allocating memory to presolve graph\n");
+        exit(-1);
+    }
+
+    p->size = size;
+    p->edges = (int *) malloc(sizeof (int) * size * size);
+    p->alive = (int *) malloc(sizeof (int) * size);
+    p->degree = (int *) malloc(sizeof (int) * size);
+    p->nodes = (int *) malloc(sizeof (int) * size);
+    p->left = size;
+    p->offset = 0;
+    p->reductions = NULL;
+    p->count = 0;
+    p->capacity = 0;
+
+    if (p->edges == NULL || p->alive == NULL || p->degree == NULL || p->nodes == NULL) {
+        printf("Error while allocating memory to presolve graph\n");
+        exit(-1);
+    }
+
+    memcpy(p->edges, edges, sizeof (int) * size * size);
+
+    for (i = 0; i < size; i++) {
+        p->alive[i] = TRUE;
+        p->degree[i] = 0;
+        p->edges[i * size + i] = 0;
+        for (j = 0; j < size; j++) {
+            if (p->edges[i * size + j] != 0) {
+                p->degree[i]++;
+            }
+        }
+    }
+
+    while (changed && p->left > PRESOLVE_MIN_NODES) {
+        changed = removeDominated(p) > 0;
+        changed = removePendants(p) > 0 || changed;
+        changed = contractChains(p) > 0 || changed;
+    }
+
+    p->reduced = (int *) malloc(sizeof (int) * p->left * p->left);
+
+    if (p->reduced == NULL) {
+        printf("Error while allocating memory to presolve graph\n");
+        exit(-1);
+    }
+
+    for (i = 0, j = 0; i < size; i++) {
+        if (p->alive[i]) {
+            p->nodes[j++] = i;
+        }
+    }
+
+    for (i = 0; i < p->left; i++) {
+        for (j = 0; j < p->left; j++) {
+            p->reduced[i * p->left + j] = p->edges[p->nodes[i] * size + p->nodes[j]];
+        }
+    }
+
+    return p;
+}
+
+void destroyPresolve(pPresolve p) {
+    if (p != NULL) {
+        int i;
+        for (i = 0; i < p->count; i++) {
+            free(p->reductions[i].chain);
+        }
+        free(p->reductions);
+        free(p->edges);
+        free(p->alive);
+        free(p->degree);
+        free(p->nodes);
+        free(p->reduced);
+        free(p);
+    }
+}
+
+int getPresolveSize(pPresolve p) {
+    return p->left;
+}
+
+const int * getPresolveEdges(pPresolve p) {
+    return p->reduced;
+}
+
+int getPresolveOffset(pPresolve p) {
+    return p->offset;
+}
+
+void setEdge(pPresolve p, int u, int v, int weight) {
+    int size = p->size;
+
+    if (p->edges[u * size + v] != 0) {
+        p->degree[u]--;
+        p->degree[v]--;
+    }
+
+    p->edges[u * size + v] = weight;
+    p->edges[v * size + u] = weight;
+
+    if (weight != 0) {
+        p->degree[u]++;
+        p->degree[v]++;
+    }
+}
+
+pReduction pushReduction(pPresolve p, int kind) {
+    pReduction r;
+
+    if (p->count == p->capacity) {
+        p->capacity = p->capacity == 0 ? 16 : p->capacity * 2;
+        p->reductions = (pReduction) realloc(p->reductions, sizeof (Reduction) * p->capacity);
+
+        if (p->reductions == NULL) {
+            printf("Error while allocating memory to presolve graph\n");
+            exit(-1);
+        }
+    }
+
+    r = &p->reductions[p->count++];
+    r->kind = kind;
+    r->length = 0;
+    r->gap = 0;
+    r->chain = NULL;
+    return r;
+}
+
+/*
+ * Floyd-Warshall over the nodes alive, an edge is dropped when some other
+ * path between its ends is strictly shorter.
+ */
+int removeDominated(pPresolve p) {
+    int size = p->size;
+    int * dist = (int *) malloc(sizeof (int) * size * size);
+    int removed = 0;
+    int i, j, k;
+
+    if (dist == NULL) {
+        printf("Error while allocating memory to presolve graph\n");
+        exit(-1);
+    }
+
+    for (i = 0; i < size * size; i++) {
+        dist[i] = p->edges[i] == 0 ? INT_MAX : p->edges[i];
+    }
+
+    for (k = 0; k < size; k++) {
+        if (p->alive[k]) {
+            for (i = 0; i < size; i++) {
+                int ik = dist[i * size + k];
+                if (p->alive[i] && ik != INT_MAX) {
+                    for (j = 0; j < size; j++) {
+                        int kj = dist[k * size + j];
+                        if (kj != INT_MAX && (long long) ik + kj < dist[i * size + j]) {
+                            dist[i * size + j] = ik + kj;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    for (i = 0; i < size; i++) {
+        for (j = i + 1; j < size; j++) {
+            int edge = p->edges[i * size + j];
+            if (edge != 0 && dist[i * size + j] < edge) {
+                setEdge(p, i, j, 0);
+                removed++;
+            }
+        }
+    }
+
+    free(dist);
+    return removed;
+}
+
+int removePendants(pPresolve p) {
+    int size = p->size;
+    int removed = 0;
+    int found = TRUE;
+    int v, a;
+
+    while (found && p->left > PRESOLVE_MIN_NODES) {
+        found = FALSE;
+
+        for (v = 0; v < size && p->left > PRESOLVE_MIN_NODES; v++) {
+            if (p->alive[v] && p->degree[v] == 1) {
+                pReduction r = pushReduction(p, PRESOLVE_PENDANT);
+
+                for (a = 0; p->edges[v * size + a] == 0; a++) {
+                }
+
+                r->node = v;
+                r->a = a;
+                r->b = a;
+                p->offset += 2 * p->edges[v * size + a];
+
+                setEdge(p, v, a, 0);
+                p->alive[v] = FALSE;
+                p->left--;
+                removed++;
+                found = TRUE;
+            }
+        }
+    }
+
+    return removed;
+}
+
+int otherNeighbor(pPresolve p, int v, int from) {
+    int size = p->size;
+    int u;
+
+    for (u = 0; u < size; u++) {
+        if (u != from && p->edges[v * size + u] != 0) {
+            return u;
+        }
+    }
+
+    return UNDEFINED;
+}
+
+int walkChain(pPresolve p, int from, int cur, int * visited, int * out, int * end) {
+    int count = 0;
+
+    while (p->degree[cur] == 2 && !visited[cur]) {
+        int next = otherNeighbor(p, cur, from);
+        visited[cur] = TRUE;
+        out[count++] = cur;
+        from = cur;
+        cur = next;
+    }
+
+    /* walking back into the chain means it is a cycle without ends */
+    *end = p->degree[cur] == 2 ? UNDEFINED : cur;
+    return count;
+}
+
+int contractChains(pPresolve p) {
+    int size = p->size;
+    int * visited = (int *) calloc(size, sizeof (int));
+    int * left = (int *) malloc(sizeof (int) * size);
+    int * right = (int *) malloc(sizeof (int) * size);
+    int * chain = (int *) malloc(sizeof (int) * size);
+    int contracted = 0;
+    int v;
+
+    if (visited == NULL || left == NULL || right == NULL || chain == NULL) {
+        printf("Error while allocating memory to presolve graph\n");
+        exit(-1);
+    }
+
+    for (v = 0; v < size; v++) {
+        if (p->alive[v] && p->degree[v] == 2 && !visited[v]) {
+            int first = otherNeighbor(p, v, UNDEFINED);
+            int second = otherNeighbor(p, v, first);
+            long long length = 0;
+            int dearest = 0;
+            int gap = 0;
+            int a, b, nl, nr, k, j, prev;
+
+            visited[v] = TRUE;
+            nl = walkChain(p, v, first, visited, left, &a);
+            nr = walkChain(p, v, second, visited, right, &b);
+            k = nl + 1 + nr;
+
+            if (a == UNDEFINED || b == UNDEFINED || a == b || k < 2
+                    || p->left - (k - 1) < PRESOLVE_MIN_NODES) {
+                continue;
+            }
+
+            for (j = 0; j < nl; j++) {
+                chain[j] = left[nl - 1 - j];
+            }
+            chain[nl] = v;
+            for (j = 0; j < nr; j++) {
+                chain[nl + 1 + j] = right[j];
+            }
+
+            for (j = 0, prev = a; j <= k; j++) {
+                int next = j < k ? chain[j] : b;
+                int edge = p->edges[prev * size + next];
+                length += edge;
+                if (edge > dearest) {
+                    dearest = edge;
+                    gap = j;
+                }
+                prev = next;
+            }
+
+            /*
+             * Reaching the chain from both ends costs twice all but its
+             * dearest edge. One node joined to a by that and to b by the
+             * dearest edge costs the same either way through or there and
+             * back from a, and no less from b, as long as the dearest edge
+             * is the longer of the two.
+             */
+            if (2 * (long long) dearest < length || length > INT_MAX) {
+                continue;
+            }
+
+            {
+                pReduction r = pushReduction(p, PRESOLVE_CHAIN);
+                r->node = chain[0];
+                r->a = a;
+                r->b = b;
+                r->length = k;
+                r->gap = gap;
+                r->chain = (int *) malloc(sizeof (int) * k);
+
+                if (r->chain == NULL) {
+                    printf("Error while allocating memory to presolve graph\n");
+                    exit(-1);
+                }
+
+                memcpy(r->chain, chain, sizeof (int) * k);
+            }
+
+            for (j = 0, prev = a; j <= k; j++) {
+                int next = j < k ? chain[j] : b;
+                setEdge(p, prev, next, 0);
+                prev = next;
+            }
+
+            for (j = 1; j < k; j++) {
+                p->alive[chain[j]] = FALSE;
+            }
+
+            p->left -= k - 1;
+            setEdge(p, a, chain[0], (int) (length - dearest));
+            setEdge(p, chain[0], b, dearest);
+            contracted++;
+        }
+    }
+
+    free(visited);
+    free(left);
+    free(right);
+    free(chain);
+    return contracted;
+}
+
+void pushNode(pWalk w, int node) {
+    if (w->length == w->capacity) {
+        w->capacity = w->capacity == 0 ? 16 : w->capacity * 2;
+        w->nodes = (int *) realloc(w->nodes, sizeof (int) * w->capacity);
+
+        if (w->nodes == NULL) {
+            printf("Error while allocating memory to expand walk\n");
+            exit(-1);
+        }
+    }
+
+    w->nodes[w->length++] = node;
+}
+
+/* the nodes between the end and the gap, there and back, without the end */
+void pushSide(pWalk w, pReduction r, int fromA) {
+    int j;
+
+    if (fromA) {
+        for (j = 0; j < r->gap; j++) {
+            pushNode(w, r->chain[j]);
+        }
+        for (j = r->gap - 2; j >= 0; j--) {
+            pushNode(w, r->chain[j]);
+        }
+    } else {
+        for (j = r->length - 1; j >= r->gap; j--) {
+            pushNode(w, r->chain[j]);
+        }
+        for (j = r->gap + 1; j < r->length; j++) {
+            pushNode(w, r->chain[j]);
+        }
+    }
+}
+
+void insertAfter(pWalk w, int node, pWalk seq) {
+    int i;
+
+    for (i = 0; i < w->length && w->nodes[i] != node; i++) {
+    }
+
+    if (i < w->length && seq->length > 0) {
+        int tail = w->length - i - 1;
+        int j;
+
+        for (j = 0; j < seq->length; j++) {
+            pushNode(w, 0);
+        }
+
+        memmove(w->nodes + i + 1 + seq->length, w->nodes + i + 1, sizeof (int) * tail);
+        memcpy(w->nodes + i + 1, seq->nodes, sizeof (int) * seq->length);
+    }
+}
+
+void undoPendant(pWalk w, pReduction r) {
+    int nodes[2];
+    Walk seq;
+
+    nodes[0] = r->node;
+    nodes[1] = r->a;
+    seq.nodes = nodes;
+    seq.length = 2;
+    seq.capacity = 2;
+
+    insertAfter(w, r->a, &seq);
+}
+
+void undoChain(pWalk w, pReduction r) {
+    Walk out = {NULL, 0, 0};
+    Walk side = {NULL, 0, 0};
+    int fromA = 0;
+    int fromB = 0;
+    int i, j;
+
+    /* start the closed walk elsewhere, so the node always has both neighbors */
+    if (w->nodes[0] == r->node) {
+        memmove(w->nodes, w->nodes + 1, sizeof (int) * (w->length - 1));
+        w->nodes[w->length - 1] = w->nodes[0];
+    }
+
+    for (i = 0; i < w->length; i++) {
+        int prev, next;
+
+        if (w->nodes[i] != r->node) {
+            pushNode(&out, w->nodes[i]);
+            continue;
+        }
+
+        prev = w->nodes[i - 1];
+        next = w->nodes[i + 1];
+
+        if (prev == r->a && next == r->b) {
+            for (j = 0; j < r->length; j++) {
+                pushNode(&out, r->chain[j]);
+            }
+        } else if (prev == r->b && next == r->a) {
+            for (j = r->length - 1; j >= 0; j--) {
+                pushNode(&out, r->chain[j]);
+            }
+        } else if (prev == r->a) {
+            /* the part past the gap is reached from b the first time the walk is there */
+            pushSide(&out, r, TRUE);
+            fromB++;
+        } else {
+            pushSide(&out, r, FALSE);
+            fromA++;
+        }
+    }
+
+    for (; fromA > 0; fromA--) {
+        side.length = 0;
+        pushSide(&side, r, TRUE);
+        pushNode(&side, r->a);
+        insertAfter(&out, r->a, &side);
+    }
+
+    for (; fromB > 0; fromB--) {
+        side.length = 0;
+        pushSide(&side, r, FALSE);
+        pushNode(&side, r->b);
+        insertAfter(&out, r->b, &side);
+    }
+
+    free(side.nodes);
+    free(w->nodes);
+    *w = out;
+}
+
+int expandPresolveWalk(pPresolve p, const int * walk, int length, int ** expanded) {
+    Walk w = {NULL, 0, 0};
+    int i, j;
+
+    for (i = 0; i < length; i++) {
+        pushNode(&w, p->nodes[walk[i]]);
+    }
+
+    for (i = p->count - 1; i >= 0; i--) {
+        if (p->reductions[i].kind == PRESOLVE_PENDANT) {
+            undoPendant(&w, &p->reductions[i]);
+        } else {
+            undoChain(&w, &p->reductions[i]);
+        }
+
+        /* an empty side leaves the end twice in a row */
+        for (j = 0, length = 0; j < w.length; j++) {
+            if (length == 0 || w.nodes[length - 1] != w.nodes[j]) {
+                w.nodes[length++] = w.nodes[j];
+            }
+        }
+        w.length = length;
+    }
+
+    *expanded = w.nodes;
+    return w.length;
+}
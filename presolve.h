@@ -0,0 +1,35 @@
+#ifndef GUARD_C_MPI_PRESOLVE
+#define GUARD_C_MPI_PRESOLVE
+
+/*
+ * Reductions of a graph that keep its shortest closed walk visiting every
+ * node:
+ *
+ *  - an edge dearer than another path between its ends is never walked
+ *  - a node left with one edge is reached by going there and back, which is
+ *    forced, so it is dropped and its cost kept aside
+ *  - a chain of nodes with two edges each is replaced by one node when its
+ *    dearest edge is at least half of it, since the chain is then either
+ *    walked through or reached from both ends up to that edge
+ *
+ * They are applied until none is left, and a walk over the reduced graph
+ * can then be expanded back into a walk over the original nodes.
+ */
+typedef struct StructPresolve Presolve, *pPresolve;
+
+// edges is a symmetric size x size matrix, 0 for a missing edge
+pPresolve createPresolve(const int * edges, int size);
+void destroyPresolve(pPresolve p);
+
+// return the nodes left after the reductions
+int getPresolveSize(pPresolve p);
+// return the size x size edge matrix of the reduced graph, size as above
+const int * getPresolveEdges(pPresolve p);
+// return the weight of the forced excursions removed from the graph
+int getPresolveOffset(pPresolve p);
+
+// walk is a closed walk of length nodes over the reduced graph, walk[0] == walk[length - 1]
+// return the length of the closed walk over the original nodes put in *expanded (to free)
+int expandPresolveWalk(pPresolve p, const int * walk, int length, int ** expanded);
+
+#endif
@@ -0,0 +1,713 @@
+#include "query.h"
+#include "graph.h"
+#include "batch.h"
+#include "unrank.h"
+
+#define TRUE 1
+#define FALSE 0
+#define UNDEFINED -1
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define QUERY_LINE_SIZE 1024
+
+/* shortest distances and predecessors from one source of the base graph */
+typedef struct StructCacheEntry {
+    struct StructCacheEntry * newer;
+    struct StructCacheEntry * older;
+    int src;
+    int pins;
+    int cached;
+    int * dist;
+    int * prev;
+} CacheEntry, *pCacheEntry;
+
+struct StructDijkstraScratch {
+    int * dist;
+    int * prev;
+    /* wanted[v] tells a target not settled yet */
+    char * wanted;
+    /* binary heap of (distance, node) pairs, stale entries are skipped */
+    int * heap;
+    /* nodes reached since the last reset, NULL when every run resets all of them */
+    int * touched;
+    int touchedCount;
+};
+
+struct StructBaseGraph {
+    int size;
+    int edges;
+    /* adjacency[u] holds degree[u] pairs of dst, weight */
+    int ** adjacency;
+    int * degree;
+    int * capacity;
+    /* slots[src] is the cached row of src, NULL when it is not cached */
+    pCacheEntry * slots;
+    pCacheEntry newest;
+    pCacheEntry oldest;
+    int cacheSize;
+    int cached;
+    long hits;
+    long misses;
+    pthread_mutex_t lock;
+};
+
+static void baseDijkstra(pBaseGraph g, int src, int * dist, int * prev);
+static void runDijkstra(pBaseGraph g, pDijkstraScratch s, const int * sources, int sourceCount,
+        const int * targets, int targetCount);
+static pCacheEntry acquireRow(pBaseGraph g, int src);
+static void releaseRow(pBaseGraph g, pCacheEntry e);
+static void unlinkEntry(pBaseGraph g, pCacheEntry e);
+static void pushNewest(pBaseGraph g, pCacheEntry e);
+static void destroyEntry(pCacheEntry e);
+static void flushCache(pBaseGraph g);
+
+pBaseGraph createBaseGraph(int size, int cacheSize) {
+    pBaseGraph g = (pBaseGraph) malloc(sizeof (BaseGraph));
+    int i;
+
+    if (g == NULL) {
+        printf("Error while allocating memory to create base graph\n");
+        exit(-1);
+    }
+
+    g->size = size;
+    g->edges = 0;
+    g->adjacency = (int**) malloc(sizeof (int*) * size);
+    g->degree = (int*) malloc(sizeof (int) * size);
+    g->capacity = (int*) malloc(sizeof (int) * size);
+    g->slots = (pCacheEntry*) malloc(sizeof (pCacheEntry) * size);
+
+    if (g->adjacency == NULL || g->degree == NULL || g->capacity == NULL || g->slots == NULL) {
+        printf("Error while allocating memory to create base graph\n");
+        exit(-1);
+    }
+
+    for (i = 0; i < size; i++) {
+        g->adjacency[i] = NULL;
+        g->degree[i] = 0;
+        g->capacity[i] = 0;
+        g->slots[i] = NULL;
+    }
+
+    g->newest = g->oldest = NULL;
+    g->cacheSize = cacheSize > 0 ? cacheSize : QUERY_CACHE_SIZE;
+    g->cached = 0;
+    g->hits = 0;
+    g->misses = 0;
+    pthread_mutex_init(&g->lock, NULL);
+
+    return g;
+}
+
+void destroyBaseGraph(pBaseGraph g) {
+    if (g != NULL) {
+        int i;
+
+        flushCache(g);
+
+        for (i = 0; i < g->size; i++) {
+            free(g->adjacency[i]);
+        }
+
+        free(g->adjacency);
+        free(g->degree);
+        free(g->capacity);
+        free(g->slots);
+        pthread_mutex_destroy(&g->lock);
+        free(g);
+    }
+}
+
+int getBaseGraphSize(pBaseGraph g) {
+    return g->size;
+}
+
+static void appendAdjacency(pBaseGraph g, int u, int v, int weight);
+
+void appendAdjacency(pBaseGraph g, int u, int v, int weight) {
+    int i;
+
+    /* a repeated edge keeps its last weight */
+    for (i = 0; i < g->degree[u]; i++) {
+        if (g->adjacency[u][2 * i] == v) {
+            g->adjacency[u][2 * i + 1] = weight;
+            return;
+        }
+    }
+
+    if (g->degree[u] == g->capacity[u]) {
+        g->capacity[u] = g->capacity[u] == 0 ? 4 : g->capacity[u] * 2;
+        g->adjacency[u] = (int*) realloc(g->adjacency[u], sizeof (int) * 2 * g->capacity[u]);
+
+        if (g->adjacency[u] == NULL) {
+            printf("Error while allocating memory to add base edge\n");
+            exit(-1);
+        }
+    }
+
+    g->adjacency[u][2 * g->degree[u]] = v;
+    g->adjacency[u][2 * g->degree[u] + 1] = weight;
+    g->degree[u]++;
+    g->edges++;
+}
+
+void addBaseEdge(pBaseGraph g, int src, int dst, int weight) {
+    if (weight == 0 || src == dst) {
+        return;
+    }
+
+    appendAdjacency(g, src, dst, weight);
+    appendAdjacency(g, dst, src, weight);
+
+    /* cached rows were computed without this edge */
+    pthread_mutex_lock(&g->lock);
+    flushCache(g);
+    pthread_mutex_unlock(&g->lock);
+}
+
+void baseDijkstra(pBaseGraph g, int src, int * dist, int * prev) {
+    DijkstraScratch s;
+
+    s.dist = dist;
+    s.prev = prev;
+    s.wanted = NULL;
+    s.touched = NULL;
+    s.heap = (int*) malloc(sizeof (int) * 2 * (g->edges + 1));
+
+    if (s.heap == NULL) {
+        printf("Error while allocating memory to run dijkstra...\n");
+        exit(-1);
+    }
+
+    runDijkstra(g, &s, &src, 1, NULL, 0);
+    free(s.heap);
+}
+
+void nearestSources(pBaseGraph g, const int * sources, int sourceCount, int * dist, int * owner) {
+    DijkstraScratch s;
+    int * chain = (int*) malloc(sizeof (int) * g->size);
+    int i;
+
+    s.dist = dist;
+    s.prev = (int*) malloc(sizeof (int) * g->size);
+    s.wanted = NULL;
+    s.touched = NULL;
+    s.heap = (int*) malloc(sizeof (int) * 2 * (g->edges + sourceCount));
+
+    if (s.prev == NULL || s.heap == NULL || chain == NULL) {
+        printf("Error while allocating memory to run dijkstra...\n");
+        exit(-1);
+    }
+
+    runDijkstra(g, &s, sources, sourceCount, NULL, 0);
+
+    for (i = 0; i < g->size; i++) {
+        owner[i] = UNDEFINED;
+    }
+
+    for (i = 0; i < sourceCount; i++) {
+        owner[sources[i]] = i;
+    }
+
+    /* a node belongs to the source its shortest path tree hangs from */
+    for (i = 0; i < g->size; i++) {
+        int count = 0;
+        int v = i;
+
+        while (owner[v] == UNDEFINED && s.prev[v] != UNDEFINED) {
+            chain[count++] = v;
+            v = s.prev[v];
+        }
+
+        while (count-- > 0) {
+            owner[chain[count]] = owner[v];
+        }
+    }
+
+    free(s.prev);
+    free(s.heap);
+    free(chain);
+}
+
+pDijkstraScratch createDijkstraScratch(pBaseGraph g) {
+    pDijkstraScratch s = (pDijkstraScratch) malloc(sizeof (DijkstraScratch));
+    int i;
+
+    if (s == NULL) {
+        printf("Error while allocating memory to run dijkstra...\n");
+        exit(-1);
+    }
+
+    s->dist = (int*) malloc(sizeof (int) * g->size);
+    s->prev = (int*) malloc(sizeof (int) * g->size);
+    s->wanted = (char*) calloc(g->size, sizeof (char));
+    s->touched = (int*) malloc(sizeof (int) * g->size);
+    s->heap = (int*) malloc(sizeof (int) * 2 * (g->edges + 1));
+    s->touchedCount = 0;
+
+    if (s->dist == NULL || s->prev == NULL || s->wanted == NULL || s->touched == NULL
+            || s->heap == NULL) {
+        printf("Error while allocating memory to run dijkstra...\n");
+        exit(-1);
+    }
+
+    for (i = 0; i < g->size; i++) {
+        s->dist[i] = INT_MAX;
+        s->prev[i] = UNDEFINED;
+    }
+
+    return s;
+}
+
+void destroyDijkstraScratch(pDijkstraScratch s) {
+    if (s != NULL) {
+        free(s->dist);
+        free(s->prev);
+        free(s->wanted);
+        free(s->touched);
+        free(s->heap);
+        free(s);
+    }
+}
+
+void targetDistances(pBaseGraph g, pDijkstraScratch s, int src, const int * targets,
+        int targetCount, int * out) {
+    int i;
+
+    runDijkstra(g, s, &src, 1, targets, targetCount);
+
+    for (i = 0; i < targetCount; i++) {
+        out[i] = s->dist[targets[i]];
+    }
+
+    /* only what this search reached is put back */
+    for (i = 0; i < s->touchedCount; i++) {
+        s->dist[s->touched[i]] = INT_MAX;
+        s->prev[s->touched[i]] = UNDEFINED;
+    }
+
+    s->touchedCount = 0;
+}
+
+/*
+ * Without a touched list every node is reset first, else dist and prev are
+ * expected clean and the nodes reached are listed to be reset afterwards.
+ * With targets the search stops once all of them are settled.
+ */
+void runDijkstra(pBaseGraph g, pDijkstraScratch s, const int * sources, int sourceCount,
+        const int * targets, int targetCount) {
+    int * dist = s->dist;
+    int * prev = s->prev;
+    int * heap = s->heap;
+    int left = 0;
+    int count = 0;
+    int i;
+
+    if (s->touched == NULL) {
+        for (i = 0; i < g->size; i++) {
+            dist[i] = INT_MAX;
+            prev[i] = UNDEFINED;
+        }
+    }
+
+    for (i = 0; i < targetCount; i++) {
+        if (!s->wanted[targets[i]]) {
+            s->wanted[targets[i]] = TRUE;
+            left++;
+        }
+    }
+
+    for (i = 0; i < sourceCount; i++) {
+        dist[sources[i]] = 0;
+        heap[2 * count] = 0;
+        heap[2 * count + 1] = sources[i];
+        count++;
+        if (s->touched != NULL) {
+            s->touched[s->touchedCount++] = sources[i];
+        }
+    }
+
+    while (count > 0) {
+        int d = heap[0];
+        int u = heap[1];
+        int pos = 0;
+
+        /* pop the root */
+        count--;
+        heap[0] = heap[2 * count];
+        heap[1] = heap[2 * count + 1];
+
+        for (;;) {
+            int child = 2 * pos + 1;
+            int t;
+            if (child >= count) {
+                break;
+            }
+            if (child + 1 < count && heap[2 * (child + 1)] < heap[2 * child]) {
+                child++;
+            }
+            if (heap[2 * pos] <= heap[2 * child]) {
+                break;
+            }
+            t = heap[2 * pos];
+            heap[2 * pos] = heap[2 * child];
+            heap[2 * child] = t;
+            t = heap[2 * pos + 1];
+            heap[2 * pos + 1] = heap[2 * child + 1];
+            heap[2 * child + 1] = t;
+            pos = child;
+        }
+
+        if (d > dist[u]) {
+            continue;
+        }
+
+        if (targets != NULL && s->wanted[u]) {
+            s->wanted[u] = FALSE;
+            if (--left == 0) {
+                break;
+            }
+        }
+
+        for (i = 0; i < g->degree[u]; i++) {
+            int v = g->adjacency[u][2 * i];
+            int alt = d + g->adjacency[u][2 * i + 1];
+
+            if (alt < dist[v]) {
+                if (s->touched != NULL && dist[v] == INT_MAX) {
+                    s->touched[s->touchedCount++] = v;
+                }
+                dist[v] = alt;
+                prev[v] = u;
+
+                /* push and sift up */
+                pos = count++;
+                heap[2 * pos] = alt;
+                heap[2 * pos + 1] = v;
+
+                while (pos > 0 && heap[2 * ((pos - 1) / 2)] > heap[2 * pos]) {
+                    int parent = (pos - 1) / 2;
+                    int t = heap[2 * pos];
+                    heap[2 * pos] = heap[2 * parent];
+                    heap[2 * parent] = t;
+                    t = heap[2 * pos + 1];
+                    heap[2 * pos + 1] = heap[2 * parent + 1];
+                    heap[2 * parent + 1] = t;
+                    pos = parent;
+                }
+            }
+        }
+    }
+
+    for (i = 0; i < targetCount; i++) {
+        s->wanted[targets[i]] = FALSE;
+    }
+}
+
+void unlinkEntry(pBaseGraph g, pCacheEntry e) {
+    if (e->newer != NULL) {
+        e->newer->older = e->older;
+    } else {
+        g->newest = e->older;
+    }
+
+    if (e->older != NULL) {
+        e->older->newer = e->newer;
+    } else {
+        g->oldest = e->newer;
+    }
+
+    e->newer = e->older = NULL;
+}
+
+void pushNewest(pBaseGraph g, pCacheEntry e) {
+    e->older = g->newest;
+    e->newer = NULL;
+
+    if (g->newest != NULL) {
+        g->newest->newer = e;
+    } else {
+        g->oldest = e;
+    }
+
+    g->newest = e;
+}
+
+void destroyEntry(pCacheEntry e) {
+    free(e->dist);
+    free(e->prev);
+    free(e);
+}
+
+void flushCache(pBaseGraph g) {
+    /* called with g->lock held, rows still in use are freed on release */
+    while (g->newest != NULL) {
+        pCacheEntry e = g->newest;
+        unlinkEntry(g, e);
+        g->slots[e->src] = NULL;
+        e->cached = FALSE;
+        if (e->pins == 0) {
+            destroyEntry(e);
+        }
+    }
+
+    g->cached = 0;
+}
+
+pCacheEntry acquireRow(pBaseGraph g, int src) {
+    pCacheEntry e;
+
+    pthread_mutex_lock(&g->lock);
+
+    e = g->slots[src];
+
+    if (e != NULL) {
+        g->hits++;
+        e->pins++;
+        unlinkEntry(g, e);
+        pushNewest(g, e);
+        pthread_mutex_unlock(&g->lock);
+        return e;
+    }
+
+    g->misses++;
+    pthread_mutex_unlock(&g->lock);
+
+    e = (pCacheEntry) malloc(sizeof (CacheEntry));
+
+    if (e != NULL) {
+        e->dist = (int*) malloc(sizeof (int) * g->size);
+        e->prev = (int*) malloc(sizeof (int) * g->size);
+    }
+
+    if (e == NULL || e->dist == NULL || e->prev == NULL) {
+        printf("Error while allocating memory for query cache\n");
+        exit(-1);
+    }
+
+    e->src = src;
+    e->pins = 1;
+    e->cached = FALSE;
+    e->newer = e->older = NULL;
+
+    baseDijkstra(g, src, e->dist, e->prev);
+
+    pthread_mutex_lock(&g->lock);
+
+    if (g->slots[src] != NULL) {
+        /* another query computed the same row meanwhile */
+        destroyEntry(e);
+        e = g->slots[src];
+        e->pins++;
+    } else {
+        pCacheEntry victim = g->oldest;
+
+        while (g->cached >= g->cacheSize && victim != NULL) {
+            pCacheEntry next = victim->newer;
+            if (victim->pins == 0) {
+                unlinkEntry(g, victim);
+                g->slots[victim->src] = NULL;
+                g->cached--;
+                destroyEntry(victim);
+            }
+            victim = next;
+        }
+
+        if (g->cached < g->cacheSize) {
+            e->cached = TRUE;
+            g->slots[src] = e;
+            g->cached++;
+            pushNewest(g, e);
+        }
+    }
+
+    pthread_mutex_unlock(&g->lock);
+    return e;
+}
+
+void releaseRow(pBaseGraph g, pCacheEntry e) {
+    pthread_mutex_lock(&g->lock);
+    if (--e->pins == 0 && !e->cached) {
+        destroyEntry(e);
+    }
+    pthread_mutex_unlock(&g->lock);
+}
+
+void getQueryCacheStats(pBaseGraph g, long * hits, long * misses) {
+    pthread_mutex_lock(&g->lock);
+    *hits = g->hits;
+    *misses = g->misses;
+    pthread_mutex_unlock(&g->lock);
+}
+
+int queryTour(pBaseGraph g, const int * stops, int count, int * tour,
+        int ** path, int * pathLength) {
+    pCacheEntry rows[UNRANK_MAX_NODES];
+    int order[UNRANK_MAX_NODES + 1];
+    int weight = 0;
+    int * scratch;
+    pSolver solver;
+    int i, j, k;
+
+    *path = NULL;
+    *pathLength = 0;
+
+    if (count < 1 || count > UNRANK_MAX_NODES) {
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (stops[i] < 0 || stops[i] >= g->size) {
+            return -1;
+        }
+        for (j = 0; j < i; j++) {
+            if (stops[i] == stops[j]) {
+                return -1;
+            }
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        rows[i] = acquireRow(g, stops[i]);
+    }
+
+    /* terminal-only distance matrix, already closed */
+    solver = createSolver(count);
+
+    for (i = 0; i < count && weight >= 0; i++) {
+        for (j = i + 1; j < count && weight >= 0; j++) {
+            int w = rows[i]->dist[stops[j]];
+            if (w == INT_MAX) {
+                weight = -1;
+            } else {
+                addSolverEdge(solver, i, j, w);
+            }
+        }
+    }
+
+    if (weight >= 0) {
+        solve(solver);
+        weight = getSolverTour(solver, order);
+    }
+
+    if (weight >= 0) {
+        *path = (int*) malloc(sizeof (int) * (count * g->size + 1));
+        scratch = (int*) malloc(sizeof (int) * g->size);
+
+        if (*path == NULL || scratch == NULL) {
+            printf("Error while allocating memory for query path\n");
+            exit(-1);
+        }
+
+        for (k = 0; k <= count; k++) {
+            tour[k] = stops[order[k]];
+        }
+
+        for (k = 0; k < count; k++) {
+            /* walk the predecessors of the leg back from its end, as printRealPath does */
+            int * prev = rows[order[k]]->prev;
+            int b = stops[order[k]];
+            int e = stops[order[k + 1]];
+            int n = 0;
+
+            while (e != b && e != UNDEFINED) {
+                e = prev[e];
+                scratch[n++] = e;
+            }
+
+            while (n-- > 0) {
+                (*path)[(*pathLength)++] = scratch[n];
+            }
+        }
+
+        (*path)[(*pathLength)++] = tour[count];
+        free(scratch);
+    }
+
+    destroySolver(solver);
+
+    for (i = 0; i < count; i++) {
+        releaseRow(g, rows[i]);
+    }
+
+    return weight;
+}
+
+void runQueries(const char * file, FILE * in, FILE * out, int cacheSize) {
+    Instance base;
+    pBaseGraph g;
+    char line[QUERY_LINE_SIZE];
+    FILE * f = fopen(file, "r");
+    long hits, misses;
+    int i;
+
+    if (f == NULL || !readInstance(f, &base)) {
+        printf("Error while reading base graph from %s\n", file);
+        exit(-1);
+    }
+
+    fclose(f);
+
+    g = createBaseGraph(base.size, cacheSize);
+
+    for (i = 0; i < base.count; i++) {
+        int src = base.edges[3 * i];
+        int dst = base.edges[3 * i + 1];
+        if (src >= 0 && dst >= 0 && src < base.size && dst < base.size) {
+            addBaseEdge(g, src, dst, base.edges[3 * i + 2]);
+        }
+    }
+
+    destroyInstance(&base);
+
+    while (fgets(line, sizeof (line), in) != NULL) {
+        char id[BATCH_ID_SIZE];
+        int stops[UNRANK_MAX_NODES];
+        int tour[UNRANK_MAX_NODES + 1];
+        int count, consumed, offset, weight;
+        int * path;
+        int pathLength;
+
+        if (sscanf(line, "query %63s %d%n", id, &count, &consumed) != 2) {
+            continue;
+        }
+
+        weight = count > 0 && count <= UNRANK_MAX_NODES ? 0 : -1;
+
+        for (i = 0, offset = consumed; i < count && weight >= 0; i++, offset += consumed) {
+            if (sscanf(line + offset, "%d%n", &stops[i], &consumed) != 1) {
+                weight = -1;
+            }
+        }
+
+        if (weight >= 0) {
+            weight = queryTour(g, stops, count, tour, &path, &pathLength);
+        }
+
+        if (weight < 0) {
+            fprintf(out, "%s error\n", id);
+        } else {
+            fprintf(out, "%s %d", id, weight);
+            for (i = 0; i <= count; i++) {
+                fprintf(out, " %d", tour[i]);
+            }
+            fprintf(out, " :");
+            for (i = 0; i < pathLength; i++) {
+                fprintf(out, " %d", path[i]);
+            }
+            fprintf(out, "\n");
+            free(path);
+        }
+
+        fflush(out);
+    }
+
+    getQueryCacheStats(g, &hits, &misses);
+    fprintf(stderr, "Query cache: %ld hits, %ld misses\n", hits, misses);
+    destroyBaseGraph(g);
+}
@@ -0,0 +1,45 @@
+#ifndef GUARD_C_MPI_QUERY
+#define GUARD_C_MPI_QUERY
+
+#include <stdio.h>
+
+/* single-source rows kept by default in the cache of a base graph */
+#define QUERY_CACHE_SIZE 256
+
+/*
+ * A base graph is loaded once and answers tour queries over a few of its
+ * nodes. The shortest path rows of the queried stops are kept in an LRU cache,
+ * so a query only pays for the rows it has not seen recently plus the search
+ * over the stops. Queries can run from several threads at once.
+ */
+typedef struct StructBaseGraph BaseGraph, *pBaseGraph;
+
+pBaseGraph createBaseGraph(int size, int cacheSize);
+void destroyBaseGraph(pBaseGraph graph);
+// nodes are numbered from 0, edges are undirected
+void addBaseEdge(pBaseGraph graph, int src, int dst, int weight);
+int getBaseGraphSize(pBaseGraph graph);
+
+// return the weight of the best tour over stops, -1 when there is none
+// tour receives count + 1 stops, *path the real path of *pathLength nodes (to free)
+int queryTour(pBaseGraph graph, const int * stops, int count, int * tour,
+        int ** path, int * pathLength);
+void getQueryCacheStats(pBaseGraph graph, long * hits, long * misses);
+
+/* buffers of one thread for many short searches, each only paying for the nodes it reaches */
+typedef struct StructDijkstraScratch DijkstraScratch, *pDijkstraScratch;
+
+pDijkstraScratch createDijkstraScratch(pBaseGraph graph);
+void destroyDijkstraScratch(pDijkstraScratch scratch);
+// out[i] receives the distance from src to targets[i], INT_MAX when unreachable,
+// the search stops once every target is settled
+void targetDistances(pBaseGraph graph, pDijkstraScratch scratch, int src, const int * targets,
+        int targetCount, int * out);
+// fill dist with the distance to the nearest of the distinct sources and owner with its index, -1 when none is reachable
+void nearestSources(pBaseGraph graph, const int * sources, int sourceCount, int * dist, int * owner);
+
+// read the base graph from the first instance of file, then answer
+// "query <id> <count> <stop> ... <stop>" lines from in
+void runQueries(const char * file, FILE * in, FILE * out, int cacheSize);
+
+#endif
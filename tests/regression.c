@@ -0,0 +1,157 @@
+#include "graph.h"
+#include "query.h"
+#include "decompose.h"
+
+#define TRUE 1
+#define FALSE 0
+#define UNDEFINED -1
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static int failures = 0;
+
+static void expect(int condition, const char * name);
+static void decomposeDisconnected(void);
+static void resolveDisconnected(void);
+static int walkWeight(const int * edges, int size, const int * walk, int length);
+static void cachedPath(void);
+
+void expect(int condition, const char * name) {
+    if (condition) {
+        printf("ok %s\n", name);
+    } else {
+        printf("FAILED %s\n", name);
+        failures++;
+    }
+}
+
+/* two triangles with no edge between them */
+void decomposeDisconnected(void) {
+    pBaseGraph g = createBaseGraph(6, 1);
+    int tour[7];
+
+    addBaseEdge(g, 0, 1, 1);
+    addBaseEdge(g, 1, 2, 1);
+    addBaseEdge(g, 2, 0, 1);
+    addBaseEdge(g, 3, 4, 1);
+    addBaseEdge(g, 4, 5, 1);
+    addBaseEdge(g, 5, 3, 1);
+
+    expect(decomposeTour(g, 2, tour) == UNDEFINED, "decompose disconnected graph");
+
+    addBaseEdge(g, 2, 3, 5);
+
+    expect(decomposeTour(g, 2, tour) == 16, "decompose after joining it");
+
+    destroyBaseGraph(g);
+}
+
+/* a 4-cycle losing two opposite edges, one resolve after each */
+void resolveDisconnected(void) {
+    pSolver s = createSolver(4);
+    int order[5];
+
+    addSolverEdge(s, 0, 1, 1);
+    addSolverEdge(s, 1, 2, 2);
+    addSolverEdge(s, 2, 3, 3);
+    addSolverEdge(s, 3, 0, 4);
+
+    expect(solve(s) == 10, "solve cycle");
+
+    updateSolverEdge(s, 0, 1, 0);
+    expect(resolve(s, TRUE) == 18, "resolve after cutting the cycle once");
+
+    updateSolverEdge(s, 2, 3, 0);
+    expect(resolve(s, TRUE) == INT_MAX, "resolve after cutting the graph");
+    expect(getSolverTour(s, order) == UNDEFINED, "no tour after cutting the graph");
+
+    updateSolverEdge(s, 2, 3, 3);
+    expect(resolve(s, TRUE) == 18, "resolve after joining the graph again");
+
+    destroySolver(s);
+}
+
+/* return the weight of a closed walk from node 0 over edges, -1 when it leaves them or misses a node */
+int walkWeight(const int * edges, int size, const int * walk, int length) {
+    int seen[8] = {0};
+    int weight = 0;
+    int i;
+
+    if (length < 2 || walk[0] != 0 || walk[length - 1] != 0) {
+        return UNDEFINED;
+    }
+
+    for (i = 0; i < length - 1; i++) {
+        if (edges[walk[i] * size + walk[i + 1]] == 0) {
+            return UNDEFINED;
+        }
+        weight += edges[walk[i] * size + walk[i + 1]];
+        seen[walk[i]] = TRUE;
+    }
+
+    for (i = 0; i < size; i++) {
+        if (!seen[i]) {
+            return UNDEFINED;
+        }
+    }
+
+    return weight;
+}
+
+/* a star around node 0 forces walks through it, presolved on a miss and read back on a hit */
+void cachedPath(void) {
+    int edges[36] = {0};
+    char file[] = "/tmp/regressionXXXXXX";
+    int fd = mkstemp(file);
+    pResultCache cache;
+    int * path;
+    int length, weight, round, i;
+
+    close(fd);
+    unlink(file);
+    cache = openResultCache(file, 64);
+
+    for (i = 1; i < 6; i++) {
+        edges[i] = edges[i * 6] = i;
+    }
+    edges[1 * 6 + 2] = edges[2 * 6 + 1] = 2;
+
+    for (round = 0; round < 2; round++) {
+        pSolver s = createSolver(6);
+        int j;
+
+        setSolverCache(s, cache);
+
+        for (i = 0; i < 6; i++) {
+            for (j = i + 1; j < 6; j++) {
+                if (edges[i * 6 + j] != 0) {
+                    addSolverEdge(s, i, j, edges[i * 6 + j]);
+                }
+            }
+        }
+
+        weight = solve(s);
+        length = getSolverPath(s, &path);
+
+        expect(weight == 29, round == 0 ? "solve star" : "solve star from the cache");
+        expect(walkWeight(edges, 6, path, length) == weight,
+                round == 0 ? "path of the star" : "path of the star from the cache");
+
+        free(path);
+        destroySolver(s);
+    }
+
+    closeResultCache(cache);
+    unlink(file);
+}
+
+int main(void) {
+    decomposeDisconnected();
+    resolveDisconnected();
+    cachedPath();
+
+    return failures == 0 ? 0 : 1;
+}
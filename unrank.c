@@ -0,0 +1,180 @@
+#include "unrank.h"
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+/*
+ * Tours are fixed at start and enumerated in a single orientation: the city
+ * visited right after start is always lower than the one visited right before
+ * returning to it, so a tour and its mirror never both get an index. An index
+ * is the rank of that (second, last) pair followed by the factorial rank of the
+ * cities visited between them, which leaves (n-1)!/2 indexes for n > 3.
+ *
+ * The cities other than start are kept as positions in a bit mask, picking
+ * the k-th still available one is a select and ranking it is a popcount.
+ */
+
+static int selectBit(unsigned long long mask, int k);
+static int countBits(unsigned long long mask);
+static unsigned long long divRadix(pUnranker u, unsigned long long x, int radix,
+        unsigned long long * rem);
+
+int countBits(unsigned long long mask) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(mask);
+#else
+    int c = 0;
+    for (; mask != 0; mask &= mask - 1) {
+        c++;
+    }
+    return c;
+#endif
+}
+
+int selectBit(unsigned long long mask, int k) {
+#if defined(__BMI2__)
+    return __builtin_ctzll(_pdep_u64(1ULL << k, mask));
+#else
+    int pos = 0;
+    int c;
+
+    /* skip whole bytes, then drop the lowest bits left before the k-th */
+    while ((c = countBits(mask & 0xFF)) <= k) {
+        k -= c;
+        mask >>= 8;
+        pos += 8;
+    }
+
+    while (k-- > 0) {
+        mask &= mask - 1;
+    }
+
+#if defined(__GNUC__)
+    return pos + __builtin_ctzll(mask);
+#else
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+        pos++;
+    }
+    return pos;
+#endif
+#endif
+}
+
+unsigned long long divRadix(pUnranker u, unsigned long long x, int radix,
+        unsigned long long * rem) {
+    unsigned long long d = u->factorials[radix];
+    unsigned long long q;
+
+#if defined(__SIZEOF_INT128__)
+    /* reciprocal is floor((2^64 - 1) / d), the estimate is short by at most one */
+    q = (unsigned long long) (((unsigned __int128) x * u->reciprocals[radix]) >> 64);
+    *rem = x - q * d;
+    if (*rem >= d) {
+        q++;
+        *rem -= d;
+    }
+#else
+    q = x / d;
+    *rem = x - q * d;
+#endif
+
+    return q;
+}
+
+void initUnranker(pUnranker u, int size) {
+    int i;
+
+    u->size = size;
+    u->factorials[0] = 1;
+    u->reciprocals[0] = ~0ULL;
+
+    for (i = 1; i < UNRANK_MAX_NODES; i++) {
+        u->factorials[i] = u->factorials[i - 1] * i;
+        u->reciprocals[i] = ~0ULL / u->factorials[i];
+    }
+}
+
+long long countCanonicalTours(pUnranker u) {
+    int m = u->size - 1;
+
+    if (m >= UNRANK_MAX_NODES) {
+        return -1;
+    }
+
+    return m < 3 ? 1 : (long long) (u->factorials[m] / 2);
+}
+
+void unrankCanonical(pUnranker u, int start, long long idx, int * order) {
+    int m = u->size - 1;
+    unsigned long long rest = (unsigned long long) idx;
+    unsigned long long avail = (1ULL << m) - 1;
+    int k;
+
+    order[0] = order[u->size] = start;
+
+    if (m == 1) {
+        order[1] = start == 0 ? 1 : 0;
+    } else if (m > 1) {
+        int pair = (int) divRadix(u, rest, m - 2, &rest);
+        int a = 0;
+        int b;
+
+        while (pair >= m - 1 - a) {
+            pair -= m - 1 - a;
+            a++;
+        }
+
+        b = a + 1 + pair;
+        order[1] = a + (a >= start);
+        order[m] = b + (b >= start);
+        avail &= ~((1ULL << a) | (1ULL << b));
+
+        for (k = 2; k < m; k++) {
+            int p = selectBit(avail, (int) divRadix(u, rest, m - 1 - k, &rest));
+            avail &= ~(1ULL << p);
+            order[k] = p + (p >= start);
+        }
+    }
+}
+
+long long rankCanonical(pUnranker u, const int * order) {
+    int m = u->size - 1;
+    int start = order[0];
+    unsigned long long avail = (1ULL << m) - 1;
+    unsigned long long idx = 0;
+    int reversed;
+    int a, b, k, x;
+
+    if (m < 2) {
+        return 0;
+    }
+
+    /* positions among the cities other than start, walking the mirror if needed */
+    a = order[1] - (order[1] > start);
+    b = order[m] - (order[m] > start);
+    reversed = a > b;
+
+    if (reversed) {
+        int t = a;
+        a = b;
+        b = t;
+    }
+
+    for (x = 0; x < a; x++) {
+        idx += m - 1 - x;
+    }
+
+    idx = (idx + b - a - 1) * u->factorials[m - 2];
+    avail &= ~((1ULL << a) | (1ULL << b));
+
+    for (k = 2; k < m; k++) {
+        int node = order[reversed ? m + 1 - k : k];
+        int p = node - (node > start);
+        idx += countBits(avail & ((1ULL << p) - 1)) * u->factorials[m - 1 - k];
+        avail &= ~(1ULL << p);
+    }
+
+    return (long long) idx;
+}
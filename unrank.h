@@ -0,0 +1,25 @@
+#ifndef GUARD_C_MPI_UNRANK
+#define GUARD_C_MPI_UNRANK
+
+/* 20! is the largest factorial radix that fits in 64 bits */
+#define UNRANK_MAX_NODES 21
+
+/*
+ * Factorial radices of an instance with the reciprocals used to divide by
+ * them, so decoding an index needs no hardware division.
+ */
+typedef struct {
+    int size;
+    unsigned long long factorials[UNRANK_MAX_NODES];
+    unsigned long long reciprocals[UNRANK_MAX_NODES];
+} Unranker, *pUnranker;
+
+void initUnranker(pUnranker u, int size);
+// return the number of canonical tours, -1 if it does not fit in 64 bits
+long long countCanonicalTours(pUnranker u);
+// fill order[0..size] with the tour of index idx, order[0] == order[size] == start
+void unrankCanonical(pUnranker u, int start, long long idx, int * order);
+// inverse of unrankCanonical, either orientation of the tour is accepted
+long long rankCanonical(pUnranker u, const int * order);
+
+#endif